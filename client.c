@@ -6,16 +6,39 @@
 #include <pthread.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #define MSG_TELEMETRIA 1
 #define MSG_ACK 2
 #define MSG_EQUIPE_DRONE 3
 #define MSG_CONCLUSAO 4
+#define MSG_ALERTA 5 // só as cidades que mudaram de estado (payload_telemetria_t truncado)
+#define MSG_CONSULTA 6 // k capitais mais próximas de um lote de cidades (somente leitura)
+#define MSG_RESPOSTA_CONSULTA 7
+
+#define CONSULTA_MAX_CIDADES 16
+#define CONSULTA_MAX_K 5
+
+#define ROTA_MAX 64 // cidades por rota (capital ... cidade em alerta)
+
+#define INTERVALO_AMOSTRAGEM 5  // s entre leituras dos sensores
+#define INTERVALO_TELEMETRIA 30 // s entre envios de telemetria
+#define INTERVALO_TELEMETRIA_MAX 240 // teto do heartbeat no modo adaptativo
+#define TIMEOUT_ACK 5           // s de espera por ACK antes de retransmitir
+#define MAX_TENTATIVAS 3
+#define MAX_REATORES 64
+#define MAX_REGIOES 16 // arquivos -g (mesmo limite de regiões do servidor)
+#define TELEMETRIA_BLOCO 50 // cidades por datagrama (payload_telemetria_t.dados)
 
 int usa_ipv4 = 0; // 1 = usa IPv4, 0 = usa IPv6
+int adaptativo = 0; // 1 = alertas imediatos + heartbeat com backoff
+const char *prefixo_journal = NULL; // missão em andamento persistida em <prefixo>.<reator>
 int n_cidades;
+int n_missoes; // vagas de missão por reator = soma das frotas das regiões carregadas
 
 /* estruturas disponibilizadas no enunciado */
 typedef struct {
@@ -30,18 +53,55 @@ typedef struct {
 
 typedef struct {
     int total;
-    telemetria_t dados[50];
+    telemetria_t dados[TELEMETRIA_BLOCO];
 } payload_telemetria_t;
 
 typedef struct {
     int status;
 } payload_ack_t;
 
+/* ACK de conclusão identifica a missão (servidores antigos mandam só o status) */
+typedef struct {
+    int status;
+    int id_cidade;
+    int id_equipe;
+} payload_ack_conclusao_t;
+
 typedef struct {
     int id_cidade;
     int id_equipe;
 } payload_equipe_drone_t;
 
+/* vai logo depois de payload_equipe_drone_t; total = 0 se não houver rota */
+typedef struct {
+    int total;
+    int cidades[ROTA_MAX];
+} payload_rota_t;
+
+typedef struct {
+    int k;
+    int total;
+    int cidades[CONSULTA_MAX_CIDADES];
+} payload_consulta_t;
+
+typedef struct {
+    int id_capital;
+    int distancia;
+    int livres; // drones disponíveis agora
+    int frota;  // drones da capital
+} capital_proxima_t;
+
+typedef struct {
+    int id_cidade;
+    int total;
+    capital_proxima_t capitais[CONSULTA_MAX_K];
+} resposta_cidade_t;
+
+typedef struct {
+    int total;
+    resposta_cidade_t cidades[CONSULTA_MAX_CIDADES];
+} payload_resposta_consulta_t;
+
 typedef struct {
     int id_cidade;
     time_t timestamp;
@@ -52,335 +112,819 @@ typedef struct Cidade {
     int _idx;
     char _nome[100];
     int _tipo;
+    int _frota; // drones da capital (coluna opcional do arquivo, padrão 1)
 } Cidade;
 
-/* leitura do arquivo */
-Cidade *ler_arquivo(FILE *f) {
+/* leitura do arquivo; com várias regiões cada uma é anexada depois das
+   anteriores, na mesma ordem de ids globais usada pelo servidor */
+Cidade *ler_arquivo(FILE *f, Cidade *c) {
     int N, M;
     fscanf(f, "%d %d", &N, &M);
     fgetc(f);
-    n_cidades = N;
+    int offset = n_cidades;
+    n_cidades += N;
 
-    Cidade *c = malloc(N * sizeof(Cidade));
+    c = realloc(c, n_cidades * sizeof(Cidade));
     char linha[256];
-    int idx, tipo;
+    int idx, tipo, frota;
     char nome[200];
     for (int k = 0; k < N; k++) {
         fgets(linha, sizeof(linha), f);
-        sscanf(linha, "%d %[^0-9] %d", &idx, nome, &tipo);
+        // "id nome tipo [frota]", mesmo formato lido pelo servidor
+        int campos = sscanf(linha, "%d %[^0-9] %d %d", &idx, nome, &tipo, &frota);
         int len = strlen(nome);
         if (len > 0 && nome[len - 1] == ' ') nome[len - 1] = '\0';
+        idx += offset;
         c[idx]._idx = idx;
         strcpy(c[idx]._nome, nome);
         c[idx]._tipo = tipo;
+        c[idx]._frota = tipo != 1 ? 0 : (campos == 4 && frota > 0) ? frota : 1;
+        n_missoes += c[idx]._frota;
     }
     return c;
 }
 
-/* sockets / endereços */
+/* endereço do servidor (somente leitura depois de main) */
 struct sockaddr_in addr4;
 struct sockaddr_in6 addr6;
-int sockfd;
-
-/* sincronização */
-pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
-payload_telemetria_t ultima_telemetria;
 
-alerta_t alerta_global = { .id_cidade = -1, .timestamp = 0, .equipe_atuando = 0 };
-int alerta_ativo = 0;
-
-pthread_cond_t cond_ack = PTHREAD_COND_INITIALIZER;
-pthread_mutex_t lock_ack = PTHREAD_MUTEX_INITIALIZER;
-int last_ack_status = -1;
-
-/* missão */
+/* missão: prazos de fim e de ACK da conclusão (ms monotônicos, 0 = nenhum),
+   todos servidos pelo único tfd_missoes do reator */
 typedef struct {
     int id_cidade;
     int id_equipe;
-    int ativa;
     int ocupada;
+    int64_t prazo_fim;
+    int64_t prazo_ack;
+    uint8_t buf_conclusao[sizeof(header_t) + sizeof(payload_equipe_drone_t)];
+    int tentativas_conclusao; // 0 = nenhuma conclusão aguardando ACK
+    char caminho[256];        // journal da missão
 } mission_t;
-mission_t current_mission;
-pthread_cond_t cond_mission = PTHREAD_COND_INITIALIZER;
-pthread_mutex_t lock_mission = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ Reator de uma estação: amostragem, telemetria, retransmissões e conclusão de
+ missão são eventos de timerfd tratados por um único epoll, sem sleeps nem
+ locks. Cada reator é independente e roda em sua própria thread.
+ */
+typedef struct {
+    int id;
+    int sockfd;
+    int epfd;
+    int tfd_amostragem;
+    int tfd_telemetria;
+    int tfd_ack_telemetria;
+    int tfd_ack_alerta;
+    int tfd_missoes; // armado para o prazo mais próximo entre as missões
+    unsigned int semente;
+    Cidade *cidades;
+
+    int *estado_atual; // última amostra, uma posição por cidade (n_cidades)
+    alerta_t alerta_global;
+    int alerta_ativo;
+
+    /* telemetria vai em blocos de TELEMETRIA_BLOCO cidades, um por vez: o ACK
+       de um bloco libera o próximo */
+    uint8_t buf_telemetria[sizeof(header_t) + sizeof(payload_telemetria_t)];
+    int tentativas_telemetria; // 0 = nenhuma telemetria aguardando ACK
+    int bloco_telemetria;      // primeira cidade do bloco em voo
+    payload_telemetria_t telemetria_enviada;
+
+    /* modo adaptativo: estado que o servidor já recebeu / já confirmou (n_cidades) */
+    int *estado_reportado;
+    int *estado_confirmado;
+    int intervalo_telemetria;
+    uint8_t buf_alerta[sizeof(header_t) + sizeof(payload_telemetria_t)];
+    size_t len_alerta;
+    payload_telemetria_t alerta_enviado;
+    int tentativas_alerta; // 0 = nenhum alerta aguardando ACK
+
+    mission_t *missoes; // n_missoes vagas: cada drone das regiões tem uma
+} reator_t;
 
 /* enviar pacote */
-ssize_t send_packet(const void *buf, size_t len) {
+ssize_t send_packet(reator_t *r, const void *buf, size_t len) {
     if (usa_ipv4) {
-        return sendto(sockfd, buf, len, 0, (struct sockaddr *)&addr4, sizeof(addr4));
+        return sendto(r->sockfd, buf, len, 0, (struct sockaddr *)&addr4, sizeof(addr4));
     } else {
-        return sendto(sockfd, buf, len, 0, (struct sockaddr *)&addr6, sizeof(addr6));
+        return sendto(r->sockfd, buf, len, 0, (struct sockaddr *)&addr6, sizeof(addr6));
     }
 }
 
-/* Thread monitoramento */
-void *thread_monitoramento(void *arg) {
-    Cidade *cidades = (Cidade *)arg;
-    srand((unsigned int)time(NULL) ^ (unsigned int)pthread_self());
-    while (1) {
-        sleep(5);
-        pthread_mutex_lock(&lock);
-        ultima_telemetria.total = n_cidades;
-        for (int i = 0; i < n_cidades && i < 50; i++) {
-            ultima_telemetria.dados[i].id_cidade = i;
-            int r = rand() % 100;
-            if (r < 3) {
-                ultima_telemetria.dados[i].status = 1;
-                alerta_ativo = 1;
-                alerta_global.id_cidade = i;
-                alerta_global.timestamp = time(NULL);
-                alerta_global.equipe_atuando = 0;
-            } else {
-                ultima_telemetria.dados[i].status = 0;
-            }
-        }
-        pthread_mutex_unlock(&lock);
+/* arma timer em segundos (0 desarma); periodico = repete com o mesmo intervalo */
+void arma_timer(int tfd, int segundos, int periodico) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = segundos;
+    if (periodico) its.it_interval.tv_sec = segundos;
+    timerfd_settime(tfd, 0, &its, NULL);
+}
+
+/* relógio monotônico em ms, base dos prazos de missão */
+int64_t agora_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* consome as expirações pendentes do timerfd */
+void limpa_timer(int tfd) {
+    uint64_t exp;
+    ssize_t n = read(tfd, &exp, sizeof(exp));
+    (void)n;
+}
+
+void envia_alerta(reator_t *r) {
+    if (send_packet(r, r->buf_alerta, r->len_alerta) < 0) {
+        perror("sendto alerta");
+        r->tentativas_alerta = 0;
+        return;
     }
+    printf("-> Alerta enviado (tentativa %d/%d)\n", r->tentativas_alerta, MAX_TENTATIVAS);
+    arma_timer(r->tfd_ack_alerta, TIMEOUT_ACK, 0);
 }
 
-/* Thread envia telemetria */
-void *thread_envia_telemetria(void *arg) {
-    Cidade *cidades = (Cidade *)arg;
-    (void)arg;
-    while (1) {
-        sleep(30);
-
-        pthread_mutex_lock(&lock);
-        payload_telemetria_t pl = ultima_telemetria;
-        pthread_mutex_unlock(&lock);
-
-        // monta payload com conversão para network order
-        payload_telemetria_t net_pl;
-        net_pl.total = htonl(pl.total);
-        for (int i = 0; i < pl.total && i < 50; i++) {
-            net_pl.dados[i].id_cidade = htonl(pl.dados[i].id_cidade);
-            net_pl.dados[i].status = htonl(pl.dados[i].status);
+/* Modo adaptativo: havendo mudança ainda não reportada, envia já todas as cidades
+   cujo estado o servidor ainda não confirmou (as de um alerta anterior sem ACK
+   vão de novo). Cabem TELEMETRIA_BLOCO por alerta; o resto sai quando este for confirmado */
+void envia_mudancas(reator_t *r) {
+    int novas = 0;
+    for (int i = 0; i < n_cidades && !novas; i++) {
+        if (r->estado_atual[i] != r->estado_reportado[i]) novas = 1;
+    }
+    if (!novas) return; // o alerta pendente (se houver) segue com suas retransmissões
+
+    payload_telemetria_t *pl = &r->alerta_enviado;
+    payload_telemetria_t net_pl;
+    pl->total = 0;
+    for (int i = 0; i < n_cidades && pl->total < TELEMETRIA_BLOCO; i++) {
+        int st = r->estado_atual[i];
+        if (st == r->estado_confirmado[i]) {
+            r->estado_reportado[i] = st;
+            continue;
         }
+        pl->dados[pl->total].id_cidade = i;
+        pl->dados[pl->total].status = st;
+        net_pl.dados[pl->total].id_cidade = htonl(i);
+        net_pl.dados[pl->total].status = htonl(st);
+        pl->total++;
+        r->estado_reportado[i] = st;
+    }
+    if (pl->total == 0) return;
+    net_pl.total = htonl(pl->total);
+
+    uint16_t tamanho = (uint16_t)(sizeof(int) + pl->total * sizeof(telemetria_t));
+    header_t h;
+    h.tipo = htons(MSG_ALERTA);
+    h.tamanho = htons(tamanho);
+    memcpy(r->buf_alerta, &h, sizeof(h));
+    memcpy(r->buf_alerta + sizeof(h), &net_pl, tamanho);
+    r->len_alerta = sizeof(h) + tamanho;
+
+    printf("\n[ENVIANDO ALERTA]\n");
+    for (int i = 0; i < pl->total; i++) {
+        int id = pl->dados[i].id_cidade;
+        printf("%s: %s (ID=%d)\n", pl->dados[i].status == 1 ? "ALERTA" : "NORMAL", r->cidades[id]._nome, id);
+    }
 
-        header_t h;
-        h.tipo = htons(MSG_TELEMETRIA);
-        h.tamanho = htons((uint16_t)sizeof(net_pl));
+    // o novo alerta inclui as mudanças que ainda aguardavam ACK
+    r->tentativas_alerta = 1;
+    envia_alerta(r);
+}
 
-        uint8_t buffer[sizeof(header_t) + sizeof(net_pl)];
-        memcpy(buffer, &h, sizeof(h));
-        memcpy(buffer + sizeof(h), &net_pl, sizeof(net_pl));
+void evento_timeout_alerta(reator_t *r) {
+    if (r->tentativas_alerta == 0) return;
+    if (r->tentativas_alerta < MAX_TENTATIVAS) {
+        r->tentativas_alerta++;
+        envia_alerta(r);
+    } else {
+        fprintf(stderr, "Alerta: sem ACK após %d tentativas\n", MAX_TENTATIVAS);
+        r->tentativas_alerta = 0;
+    }
+}
 
-        // prints conforme enunciado
-        printf("\n[ENVIANDO TELEMETRIA]\n");
-        printf("Total de cidades: %d\n", pl.total);
-        for (int i = 0; i < pl.total && i < 50; i++) {
-            if (pl.dados[i].status == 1) {
-                printf("ALERTA: %s (ID=%d)\n", cidades[pl.dados[i].id_cidade]._nome, pl.dados[i].id_cidade);
-            }
+/* Amostragem dos sensores */
+void evento_amostragem(reator_t *r) {
+    for (int i = 0; i < n_cidades; i++) {
+        int sorteio = rand_r(&r->semente) % 100;
+        if (sorteio < 3) {
+            r->estado_atual[i] = 1;
+            r->alerta_ativo = 1;
+            r->alerta_global.id_cidade = i;
+            r->alerta_global.timestamp = time(NULL);
+            r->alerta_global.equipe_atuando = 0;
+        } else {
+            r->estado_atual[i] = 0;
         }
+    }
+    if (adaptativo) envia_mudancas(r);
+}
 
-        int tries = 0;
-        int ack_received = 0;
-        while (tries < 3 && !ack_received) {
-            printf("-> Telemetria enviada (tentativa %d/3)\n", tries + 1);
-            ssize_t sent = send_packet(buffer, sizeof(buffer));
-            if (sent < 0) {
-                perror("sendto telemetria");
-                break;
-            }
+void envia_telemetria(reator_t *r) {
+    printf("-> Telemetria enviada (tentativa %d/%d)\n", r->tentativas_telemetria, MAX_TENTATIVAS);
+    if (send_packet(r, r->buf_telemetria, sizeof(r->buf_telemetria)) < 0) {
+        perror("sendto telemetria");
+        r->tentativas_telemetria = 0;
+        return;
+    }
+    arma_timer(r->tfd_ack_telemetria, TIMEOUT_ACK, 0);
+}
 
-            // espera ACK status==0
-            struct timespec ts;
-            clock_gettime(CLOCK_REALTIME, &ts);
-            ts.tv_sec += 5;
+/* monta e envia o bloco de até TELEMETRIA_BLOCO cidades que começa em r->bloco_telemetria */
+void envia_bloco_telemetria(reator_t *r) {
+    payload_telemetria_t *pl = &r->telemetria_enviada;
+    pl->total = 0;
+    for (int i = r->bloco_telemetria; i < n_cidades && pl->total < TELEMETRIA_BLOCO; i++) {
+        pl->dados[pl->total].id_cidade = i;
+        pl->dados[pl->total].status = r->estado_atual[i];
+        pl->total++;
+    }
 
-            pthread_mutex_lock(&lock_ack);
-            last_ack_status = -1;
-            int rc = 0;
-            while (last_ack_status == -1 && rc == 0) {
-                rc = pthread_cond_timedwait(&cond_ack, &lock_ack, &ts);
-            }
-            if (rc == 0 && last_ack_status == 0) {
-                ack_received = 1;
-            }
-            pthread_mutex_unlock(&lock_ack);
+    // monta payload com conversão para network order
+    payload_telemetria_t net_pl;
+    memset(&net_pl, 0, sizeof(net_pl));
+    net_pl.total = htonl(pl->total);
+    for (int i = 0; i < pl->total; i++) {
+        net_pl.dados[i].id_cidade = htonl(pl->dados[i].id_cidade);
+        net_pl.dados[i].status = htonl(pl->dados[i].status);
+    }
 
-            if (!ack_received) tries++;
+    header_t h;
+    h.tipo = htons(MSG_TELEMETRIA);
+    h.tamanho = htons((uint16_t)sizeof(net_pl));
+    memcpy(r->buf_telemetria, &h, sizeof(h));
+    memcpy(r->buf_telemetria + sizeof(h), &net_pl, sizeof(net_pl));
+
+    // prints conforme enunciado
+    printf("\n[ENVIANDO TELEMETRIA]\n");
+    printf("Total de cidades: %d\n", pl->total);
+    for (int i = 0; i < pl->total; i++) {
+        if (pl->dados[i].status == 1) {
+            printf("ALERTA: %s (ID=%d)\n", r->cidades[pl->dados[i].id_cidade]._nome, pl->dados[i].id_cidade);
         }
+    }
 
-        if (ack_received) {
-            printf(". ACK recebido do servidor\n");
-        } else {
-            fprintf(stderr, "Telemetria: sem ACK após 3 tentativas\n");
+    r->tentativas_telemetria = 1;
+    envia_telemetria(r);
+}
+
+/* Envio periódico de telemetria */
+void evento_telemetria(reator_t *r) {
+    // uma telemetria nova substitui a que ainda aguardava ACK
+    r->bloco_telemetria = 0;
+    envia_bloco_telemetria(r);
+
+    if (adaptativo) {
+        // heartbeat recua enquanto o servidor já conhece todo o estado atual
+        int sincronizado = 1;
+        for (int i = 0; i < n_cidades; i++) {
+            if (r->estado_atual[i] != r->estado_confirmado[i]) sincronizado = 0;
+            r->estado_reportado[i] = r->estado_atual[i];
+        }
+        if (!sincronizado) {
+            r->intervalo_telemetria = INTERVALO_TELEMETRIA;
+        } else if (r->intervalo_telemetria < INTERVALO_TELEMETRIA_MAX) {
+            r->intervalo_telemetria *= 2;
+            if (r->intervalo_telemetria > INTERVALO_TELEMETRIA_MAX) r->intervalo_telemetria = INTERVALO_TELEMETRIA_MAX;
         }
+        arma_timer(r->tfd_telemetria, r->intervalo_telemetria, 0);
     }
 }
 
-/* Thread de recepção */
-void *thread_recebe(void *arg) {
-    Cidade *cidades = (Cidade *)arg;
-    (void)arg;
-    uint8_t buffer[2048];
-    while (1) {
-        ssize_t len = recv(sockfd, buffer, sizeof(buffer), 0);
-        if (len < 0) {
-            if (errno == EINTR) continue;
-            perror("recv");
-            continue;
+void evento_timeout_telemetria(reator_t *r) {
+    if (r->tentativas_telemetria == 0) return;
+    if (r->tentativas_telemetria < MAX_TENTATIVAS) {
+        r->tentativas_telemetria++;
+        envia_telemetria(r);
+    } else {
+        fprintf(stderr, "Telemetria: sem ACK após %d tentativas\n", MAX_TENTATIVAS);
+        r->tentativas_telemetria = 0;
+    }
+}
+
+/* registro da missão em disco: sobrevive a um crash até a conclusão ser confirmada */
+typedef struct {
+    int id_cidade;
+    int id_equipe;
+    int64_t fim; // time(NULL) previsto para o fim da missão
+} registro_missao_t;
+
+void salva_missao(mission_t *m, time_t fim) {
+    if (!prefixo_journal) return;
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", m->caminho);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("journal missão");
+        return;
+    }
+    registro_missao_t reg = { m->id_cidade, m->id_equipe, (int64_t)fim };
+    if (write(fd, &reg, sizeof(reg)) != (ssize_t)sizeof(reg)) perror("journal missão write");
+    fsync(fd);
+    close(fd);
+    if (rename(tmp, m->caminho) < 0) perror("journal missão rename");
+}
+
+/* arma tfd_missoes para o prazo mais próximo entre as missões (desarma se não há nenhum) */
+void rearma_missoes(reator_t *r) {
+    int64_t proximo = 0;
+    for (int i = 0; i < n_missoes; i++) {
+        mission_t *m = &r->missoes[i];
+        if (!m->ocupada) continue;
+        if (m->prazo_fim && (!proximo || m->prazo_fim < proximo)) proximo = m->prazo_fim;
+        if (m->prazo_ack && (!proximo || m->prazo_ack < proximo)) proximo = m->prazo_ack;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (proximo) {
+        its.it_value.tv_sec = proximo / 1000;
+        its.it_value.tv_nsec = (proximo % 1000) * 1000000;
+    }
+    timerfd_settime(r->tfd_missoes, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* prazo da missão daqui a segundos (0 cancela) */
+void agenda_missao(reator_t *r, int64_t *prazo, int segundos) {
+    *prazo = segundos ? agora_ms() + (int64_t)segundos * 1000 : 0;
+    rearma_missoes(r);
+}
+
+/* libera a vaga da missão (um disparo já armado para ela só encontra a vaga livre) */
+void finaliza_missao(mission_t *m) {
+    m->ocupada = 0;
+    m->prazo_fim = 0;
+    m->prazo_ack = 0;
+    m->tentativas_conclusao = 0;
+    if (prefixo_journal) unlink(m->caminho);
+}
+
+/* Inicia a missão: a conclusão vira um timer de duração aleatória */
+void inicia_missao(reator_t *r, mission_t *m) {
+    printf("\n[MISSÃO EM ANDAMENTO]\n");
+    printf("Equipe %s atuando em %s\n", r->cidades[m->id_equipe]._nome, r->cidades[m->id_cidade]._nome);
+    int dur = rand_r(&r->semente) % 31;
+    if (dur == 0) dur = 1;
+    printf(". Tempo estimado : %d segundos\n", dur);
+    salva_missao(m, time(NULL) + dur);
+    agenda_missao(r, &m->prazo_fim, dur);
+}
+
+/* retoma a missão que estava em andamento quando o processo caiu */
+void recupera_missao(reator_t *r, mission_t *m) {
+    FILE *f = fopen(m->caminho, "rb");
+    if (!f) return;
+    registro_missao_t reg;
+    int ok = fread(&reg, sizeof(reg), 1, f) == 1 && reg.id_cidade >= 0 && reg.id_cidade < n_cidades &&
+             reg.id_equipe >= 0 && reg.id_equipe < n_cidades;
+    fclose(f);
+    if (!ok) {
+        unlink(m->caminho);
+        return;
+    }
+
+    m->id_cidade = reg.id_cidade;
+    m->id_equipe = reg.id_equipe;
+    m->ocupada = 1;
+    int restante = (int)(reg.fim - (int64_t)time(NULL));
+    if (restante < 1) restante = 1; // já terminou: conclui assim que o reator rodar
+
+    printf("[MISSÃO RECUPERADA]\n");
+    printf("Equipe %s atuando em %s (restam %d segundos)\n",
+           r->cidades[reg.id_equipe]._nome, r->cidades[reg.id_cidade]._nome, restante);
+    agenda_missao(r, &m->prazo_fim, restante);
+}
+
+void envia_conclusao(reator_t *r, mission_t *m) {
+    if (send_packet(r, m->buf_conclusao, sizeof(m->buf_conclusao)) < 0) {
+        perror("sendto conclusão");
+        finaliza_missao(m);
+        return;
+    }
+    printf("-> Conclusão enviada ao servidor (tentativa %d/%d)\n", m->tentativas_conclusao, MAX_TENTATIVAS);
+    agenda_missao(r, &m->prazo_ack, TIMEOUT_ACK);
+}
+
+void evento_missao_concluida(reator_t *r, mission_t *m) {
+    printf(". Missão concluída! (%s em %s)\n", r->cidades[m->id_equipe]._nome, r->cidades[m->id_cidade]._nome);
+
+    // envia MSG_CONCLUSAO
+    header_t h;
+    payload_equipe_drone_t concl;
+    h.tipo = htons(MSG_CONCLUSAO);
+    h.tamanho = htons(sizeof(concl));
+    concl.id_cidade = htonl(m->id_cidade);
+    concl.id_equipe = htonl(m->id_equipe);
+    memcpy(m->buf_conclusao, &h, sizeof(h));
+    memcpy(m->buf_conclusao + sizeof(h), &concl, sizeof(concl));
+
+    m->tentativas_conclusao = 1;
+    envia_conclusao(r, m);
+}
+
+void evento_timeout_conclusao(reator_t *r, mission_t *m) {
+    if (m->tentativas_conclusao == 0) return;
+    if (m->tentativas_conclusao < MAX_TENTATIVAS) {
+        m->tentativas_conclusao++;
+        envia_conclusao(r, m);
+    } else {
+        fprintf(stderr, "Conclusão: sem ACK do servidor após %d tentativas. Liberando equipe localmente.\n", MAX_TENTATIVAS);
+        finaliza_missao(m);
+    }
+}
+
+/* tfd_missoes disparou: trata todos os prazos vencidos e rearma para o próximo */
+void evento_prazos_missao(reator_t *r) {
+    int64_t agora = agora_ms();
+    for (int i = 0; i < n_missoes; i++) {
+        mission_t *m = &r->missoes[i];
+        if (!m->ocupada) continue;
+        if (m->prazo_fim && m->prazo_fim <= agora) {
+            m->prazo_fim = 0;
+            evento_missao_concluida(r, m);
+        }
+        if (m->ocupada && m->prazo_ack && m->prazo_ack <= agora) {
+            m->prazo_ack = 0;
+            evento_timeout_conclusao(r, m);
         }
-        if (len < (ssize_t)sizeof(header_t)) continue;
-
-        header_t h;
-        memcpy(&h, buffer, sizeof(h));
-        uint16_t tipo = ntohs(h.tipo);
-        uint16_t tamanho = ntohs(h.tamanho);
-        uint8_t *payload = buffer + sizeof(header_t);
-
-        if (tipo == MSG_EQUIPE_DRONE) {
-            if (tamanho >= sizeof(payload_equipe_drone_t)) {
-                payload_equipe_drone_t p;
-                memcpy(&p, payload, sizeof(p));
-                int id_cidade = ntohl(p.id_cidade);
-                int id_equipe = ntohl(p.id_equipe);
-
-                printf("\n[ORDEM DE DRONE RECEBIDA]\n");
-                printf("Cidade : %s (ID=%d)\n", cidades[id_cidade]._nome, id_cidade);
-                printf("Equipe : %s (ID=%d)\n", cidades[id_equipe]._nome, id_equipe);
-
-                // envia ACK (status=1) ao servidor (em network order)
-                header_t ack_h;
-                payload_ack_t ack_p;
-                ack_h.tipo = htons(MSG_ACK);
-                ack_h.tamanho = htons(sizeof(ack_p));
-                ack_p.status = htonl(1);
-
-                uint8_t ack_buf[sizeof(header_t) + sizeof(ack_p)];
-                memcpy(ack_buf, &ack_h, sizeof(ack_h));
-                memcpy(ack_buf + sizeof(ack_h), &ack_p, sizeof(ack_p));
-                send_packet(ack_buf, sizeof(ack_buf));
-                printf("-> ACK enviado ao servidor\n");
-
-                // registra missão se possível
-                pthread_mutex_lock(&lock_mission);
-                if (current_mission.ocupada) {
-                    printf("Já existe missão ativa, ordem ignorada\n");
-                } else {
-                    current_mission.id_cidade = id_cidade;
-                    current_mission.id_equipe = id_equipe;
-                    current_mission.ativa = 1;
-                    current_mission.ocupada = 1;
-                    pthread_cond_signal(&cond_mission);
-                    printf("-> Missão registrada para execução\n");
+    }
+    rearma_missoes(r);
+}
+
+/* Ordem que a estação não vai executar: conclui na hora para o servidor
+   devolver o drone (sem retransmissão; se perder, o alerta fica com a equipe) */
+void recusa_ordem(reator_t *r, int id_cidade, int id_equipe) {
+    header_t h;
+    payload_equipe_drone_t concl;
+    h.tipo = htons(MSG_CONCLUSAO);
+    h.tamanho = htons(sizeof(concl));
+    concl.id_cidade = htonl(id_cidade);
+    concl.id_equipe = htonl(id_equipe);
+    uint8_t buf[sizeof(h) + sizeof(concl)];
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), &concl, sizeof(concl));
+    if (send_packet(r, buf, sizeof(buf)) < 0) perror("sendto conclusão");
+    printf("-> Ordem recusada: conclusão enviada para liberar o drone\n");
+}
+
+/* Recepção de datagramas do servidor */
+void evento_recebe(reator_t *r) {
+    uint8_t buffer[2048];
+    ssize_t len = recv(r->sockfd, buffer, sizeof(buffer), 0);
+    if (len < 0) {
+        if (errno != EINTR && errno != EAGAIN) perror("recv");
+        return;
+    }
+    if (len < (ssize_t)sizeof(header_t)) return;
+
+    header_t h;
+    memcpy(&h, buffer, sizeof(h));
+    uint16_t tipo = ntohs(h.tipo);
+    uint16_t tamanho = ntohs(h.tamanho);
+    uint8_t *payload = buffer + sizeof(header_t);
+
+    if (tipo == MSG_EQUIPE_DRONE) {
+        if (tamanho >= sizeof(payload_equipe_drone_t)) {
+            payload_equipe_drone_t p;
+            memcpy(&p, payload, sizeof(p));
+            int id_cidade = ntohl(p.id_cidade);
+            int id_equipe = ntohl(p.id_equipe);
+
+            // com regiões o servidor pode mandar ids de uma região não carregada com -g
+            int ids_ok = id_cidade >= 0 && id_cidade < n_cidades && id_equipe >= 0 && id_equipe < n_cidades;
+
+            printf("\n[ORDEM DE DRONE RECEBIDA]\n");
+            if (ids_ok) {
+                printf("Cidade : %s (ID=%d)\n", r->cidades[id_cidade]._nome, id_cidade);
+                printf("Equipe : %s (ID=%d)\n", r->cidades[id_equipe]._nome, id_equipe);
+            } else {
+                printf("Cidade : ID=%d, Equipe : ID=%d (fora das regiões carregadas)\n", id_cidade, id_equipe);
+            }
+
+            // rota opcional depois do payload (servidores antigos não mandam)
+            size_t bytes_rota = (size_t)len - sizeof(header_t) - sizeof(p);
+            if (tamanho - sizeof(p) < bytes_rota) bytes_rota = tamanho - sizeof(p);
+            if (bytes_rota >= sizeof(int)) {
+                payload_rota_t rota;
+                if (bytes_rota > sizeof(rota)) bytes_rota = sizeof(rota);
+                memcpy(&rota, payload + sizeof(p), bytes_rota);
+                int total = ntohl(rota.total);
+                int cabem = (int)((bytes_rota - sizeof(int)) / sizeof(int));
+                if (total > cabem) total = cabem;
+                if (total > 0) {
+                    printf("Rota   :");
+                    for (int i = 0; i < total; i++) {
+                        int id = ntohl(rota.cidades[i]);
+                        if (id < 0 || id >= n_cidades) break;
+                        printf("%s %s", i ? " ->" : "", r->cidades[id]._nome);
+                    }
+                    printf("\n");
                 }
-                pthread_mutex_unlock(&lock_mission);
             }
-        } else if (tipo == MSG_ACK) {
-            if (tamanho >= sizeof(payload_ack_t)) {
-                payload_ack_t ap;
-                memcpy(&ap, payload, sizeof(ap));
-                int status = ntohl(ap.status);
-                pthread_mutex_lock(&lock_ack);
-                last_ack_status = status;
-                pthread_cond_signal(&cond_ack);
-                pthread_mutex_unlock(&lock_ack);
-                // log opcional:
-                //printf("[DEBUG] MSG_ACK status=%d\n", status);
+
+            // envia ACK (status=1) ao servidor (em network order)
+            header_t ack_h;
+            payload_ack_t ack_p;
+            ack_h.tipo = htons(MSG_ACK);
+            ack_h.tamanho = htons(sizeof(ack_p));
+            ack_p.status = htonl(1);
+
+            uint8_t ack_buf[sizeof(header_t) + sizeof(ack_p)];
+            memcpy(ack_buf, &ack_h, sizeof(ack_h));
+            memcpy(ack_buf + sizeof(ack_h), &ack_p, sizeof(ack_p));
+            send_packet(r, ack_buf, sizeof(ack_buf));
+            printf("-> ACK enviado ao servidor\n");
+
+            if (!ids_ok) {
+                recusa_ordem(r, id_cidade, id_equipe);
+                return;
             }
-        } else {
-            // outros
+
+            // registra missão numa vaga livre
+            mission_t *livre = NULL;
+            for (int i = 0; i < n_missoes && !livre; i++) {
+                if (!r->missoes[i].ocupada) livre = &r->missoes[i];
+            }
+            if (!livre) {
+                printf("Todas as %d vagas de missão ocupadas\n", n_missoes);
+                recusa_ordem(r, id_cidade, id_equipe);
+            } else {
+                livre->id_cidade = id_cidade;
+                livre->id_equipe = id_equipe;
+                livre->ocupada = 1;
+                printf("-> Missão registrada para execução\n");
+                inicia_missao(r, livre);
+            }
+        }
+    } else if (tipo == MSG_ACK) {
+        if (tamanho >= sizeof(payload_ack_t)) {
+            payload_ack_t ap;
+            memcpy(&ap, payload, sizeof(ap));
+            int status = ntohl(ap.status);
+            if (status == 0 && r->tentativas_telemetria > 0) {
+                r->tentativas_telemetria = 0;
+                arma_timer(r->tfd_ack_telemetria, 0, 0);
+                for (int i = 0; i < r->telemetria_enviada.total; i++) {
+                    r->estado_confirmado[r->telemetria_enviada.dados[i].id_cidade] = r->telemetria_enviada.dados[i].status;
+                }
+                printf(". ACK recebido do servidor\n");
+                r->bloco_telemetria += TELEMETRIA_BLOCO;
+                if (r->bloco_telemetria < n_cidades) envia_bloco_telemetria(r);
+            } else if (status == 3 && r->tentativas_alerta > 0) {
+                r->tentativas_alerta = 0;
+                arma_timer(r->tfd_ack_alerta, 0, 0);
+                for (int i = 0; i < r->alerta_enviado.total; i++) {
+                    r->estado_confirmado[r->alerta_enviado.dados[i].id_cidade] = r->alerta_enviado.dados[i].status;
+                }
+                printf(". ACK de alerta recebido do servidor\n");
+                if (adaptativo) envia_mudancas(r); // mudanças que não couberam no alerta anterior
+            } else if (status == 2) {
+                // com ids, casa a missão exata; sem ids, a conclusão pendente mais antiga
+                payload_ack_conclusao_t ac;
+                int com_ids = tamanho >= sizeof(ac) && (size_t)len >= sizeof(header_t) + sizeof(ac);
+                if (com_ids) memcpy(&ac, payload, sizeof(ac));
+                for (int i = 0; i < n_missoes; i++) {
+                    mission_t *m = &r->missoes[i];
+                    if (!m->ocupada || m->tentativas_conclusao == 0) continue;
+                    if (com_ids && ((int)ntohl(ac.id_cidade) != m->id_cidade || (int)ntohl(ac.id_equipe) != m->id_equipe)) continue;
+                    printf("-> ACK de encerramento recebido do servidor\n");
+                    finaliza_missao(m);
+                    rearma_missoes(r);
+                    break;
+                }
+            }
+            // log opcional:
+            //printf("[DEBUG] MSG_ACK status=%d\n", status);
         }
+    } else {
+        // outros
     }
 }
 
-/* Thread atuação (drones) */
-void *thread_atuacao(void *arg) {
-    Cidade *cidades = (Cidade *)arg;
-    (void)arg;
-    while (1) {
-        pthread_mutex_lock(&lock_mission);
-        while (!current_mission.ativa) {
-            pthread_cond_wait(&cond_mission, &lock_mission);
+int registra_fd(reator_t *r, int fd) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    return epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int cria_reator(reator_t *r, int id, Cidade *cidades) {
+    memset(r, 0, sizeof(*r));
+    r->id = id;
+    r->cidades = cidades;
+    r->alerta_global.id_cidade = -1;
+    r->semente = (unsigned int)time(NULL) ^ ((unsigned int)id * 2654435761u);
+    r->estado_atual = calloc(n_cidades, sizeof(int));
+    r->estado_reportado = calloc(n_cidades, sizeof(int));
+    r->estado_confirmado = calloc(n_cidades, sizeof(int));
+    r->missoes = calloc(n_missoes, sizeof(mission_t));
+
+    r->sockfd = socket(usa_ipv4 ? AF_INET : AF_INET6, SOCK_DGRAM, 0);
+    if (r->sockfd < 0) { perror("socket"); return -1; }
+    r->epfd = epoll_create1(0);
+    if (r->epfd < 0) { perror("epoll_create1"); return -1; }
+
+    int *tfds[] = { &r->tfd_amostragem, &r->tfd_telemetria, &r->tfd_ack_telemetria, &r->tfd_ack_alerta,
+                    &r->tfd_missoes };
+    for (size_t i = 0; i < sizeof(tfds) / sizeof(tfds[0]); i++) {
+        *tfds[i] = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (*tfds[i] < 0) { perror("timerfd_create"); return -1; }
+        if (registra_fd(r, *tfds[i]) < 0) { perror("epoll_ctl"); return -1; }
+    }
+    if (registra_fd(r, r->sockfd) < 0) { perror("epoll_ctl"); return -1; }
+
+    if (prefixo_journal) {
+        for (int i = 0; i < n_missoes; i++) {
+            mission_t *m = &r->missoes[i];
+            snprintf(m->caminho, sizeof(m->caminho), "%s.%d.%d", prefixo_journal, id, i);
+            recupera_missao(r, m);
         }
-        int id_cidade = current_mission.id_cidade;
-        int id_equipe = current_mission.id_equipe;
-        current_mission.ativa = 0;
-        pthread_mutex_unlock(&lock_mission);
-
-        printf("\n[MISSÃO EM ANDAMENTO]\n");
-        printf("Equipe %s atuando em %s\n", cidades[id_equipe]._nome, cidades[id_cidade]._nome);
-        srand((unsigned int)time(NULL) ^ (unsigned int)pthread_self());
-        int dur = rand() % 31;
-        printf(". Tempo estimado : %d segundos\n", dur > 0 ? dur : 1);
-        sleep(dur > 0 ? dur : 1);
-        printf(". Missão concluída!\n");
-
-        // envia MSG_CONCLUSAO
-        header_t h;
-        payload_equipe_drone_t concl;
-        h.tipo = htons(MSG_CONCLUSAO);
-        h.tamanho = htons(sizeof(concl));
-        concl.id_cidade = htonl(id_cidade);
-        concl.id_equipe = htonl(id_equipe);
-
-        uint8_t buf[sizeof(h) + sizeof(concl)];
-        memcpy(buf, &h, sizeof(h));
-        memcpy(buf + sizeof(h), &concl, sizeof(concl));
-
-        int tries = 0;
-        int ack_recebido = 0;
-        while (tries < 3 && !ack_recebido) {
-            ssize_t s = send_packet(buf, sizeof(buf));
-            if (s < 0) {
-                perror("sendto conclusão");
-                break;
-            }
-            printf("-> Conclusão enviada ao servidor (tentativa %d/3)\n", tries + 1);
+    }
 
-            struct timespec ts;
-            clock_gettime(CLOCK_REALTIME, &ts);
-            ts.tv_sec += 5;
+    arma_timer(r->tfd_amostragem, INTERVALO_AMOSTRAGEM, 1);
+    r->intervalo_telemetria = INTERVALO_TELEMETRIA;
+    arma_timer(r->tfd_telemetria, INTERVALO_TELEMETRIA, !adaptativo);
+    return 0;
+}
 
-            pthread_mutex_lock(&lock_ack);
-            last_ack_status = -1;
-            int rc = 0;
-            while (last_ack_status == -1 && rc == 0) {
-                rc = pthread_cond_timedwait(&cond_ack, &lock_ack, &ts);
+/* Laço de eventos do reator */
+void *executa_reator(void *arg) {
+    reator_t *r = (reator_t *)arg;
+    struct epoll_event eventos[8];
+    while (1) {
+        int n = epoll_wait(r->epfd, eventos, 8, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            int fd = eventos[i].data.fd;
+            if (fd == r->sockfd) {
+                evento_recebe(r);
+                continue;
             }
-            if (rc == 0 && last_ack_status == 2) ack_recebido = 1;
-            pthread_mutex_unlock(&lock_ack);
-
-            if (!ack_recebido) tries++;
+            limpa_timer(fd);
+            if (fd == r->tfd_amostragem) evento_amostragem(r);
+            else if (fd == r->tfd_telemetria) evento_telemetria(r);
+            else if (fd == r->tfd_ack_telemetria) evento_timeout_telemetria(r);
+            else if (fd == r->tfd_ack_alerta) evento_timeout_alerta(r);
+            else if (fd == r->tfd_missoes) evento_prazos_missao(r);
         }
+    }
+    return NULL;
+}
 
-        if (ack_recebido) {
-            printf("-> ACK de encerramento recebido do servidor\n");
-        } else {
-            fprintf(stderr, "Conclusão: sem ACK do servidor após 3 tentativas. Liberando equipe localmente.\n");
+/* Consulta avulsa: "quais k capitais cobrem estas cidades e a que distância?" */
+int consulta_capitais(Cidade *cidades, const char *lista, int k) {
+    payload_consulta_t q;
+    int total = 0;
+    char copia[512];
+    snprintf(copia, sizeof(copia), "%s", lista);
+    for (char *tok = strtok(copia, ","); tok && total < CONSULTA_MAX_CIDADES; tok = strtok(NULL, ",")) {
+        int id = atoi(tok);
+        if (id < 0 || id >= n_cidades) {
+            fprintf(stderr, "Cidade inválida: %s\n", tok);
+            return 1;
+        }
+        q.cidades[total++] = htonl(id);
+    }
+    q.k = htonl(k);
+    q.total = htonl(total);
+
+    header_t h;
+    uint16_t tamanho = (uint16_t)(2 * sizeof(int) + total * sizeof(int));
+    h.tipo = htons(MSG_CONSULTA);
+    h.tamanho = htons(tamanho);
+    uint8_t buf[sizeof(header_t) + sizeof(payload_consulta_t)];
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), &q, tamanho);
+
+    reator_t r; // só o socket é usado
+    r.sockfd = socket(usa_ipv4 ? AF_INET : AF_INET6, SOCK_DGRAM, 0);
+    if (r.sockfd < 0) { perror("socket"); return 1; }
+    struct timeval tv = { TIMEOUT_ACK, 0 };
+    setsockopt(r.sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    // servidor com regiões responde em um datagrama por região: junta até cobrir todas as cidades
+    uint8_t resp_buf[sizeof(header_t) + sizeof(payload_resposta_consulta_t)];
+    resposta_cidade_t respostas[CONSULTA_MAX_CIDADES];
+    int respondida[CONSULTA_MAX_CIDADES] = { 0 };
+    int n_respondidas = 0;
+    for (int tries = 0; tries < MAX_TENTATIVAS && n_respondidas < total; tries++) {
+        if (send_packet(&r, buf, sizeof(h) + tamanho) < 0) {
+            perror("sendto consulta");
+            break;
         }
+        ssize_t len;
+        while (n_respondidas < total && (len = recv(r.sockfd, resp_buf, sizeof(resp_buf), 0)) >= 0) {
+            header_t rh;
+            if (len < (ssize_t)(sizeof(rh) + sizeof(int))) continue;
+            memcpy(&rh, resp_buf, sizeof(rh));
+            if (ntohs(rh.tipo) != MSG_RESPOSTA_CONSULTA) continue;
+
+            payload_resposta_consulta_t resp;
+            memset(&resp, 0, sizeof(resp));
+            size_t bytes = (size_t)len - sizeof(header_t);
+            if (bytes > sizeof(resp)) bytes = sizeof(resp);
+            memcpy(&resp, resp_buf + sizeof(header_t), bytes);
+            int n_resp = ntohl(resp.total);
+            if (n_resp < 0 || n_resp > CONSULTA_MAX_CIDADES) n_resp = 0;
+            for (int i = 0; i < n_resp; i++) {
+                for (int j = 0; j < total; j++) {
+                    if (respondida[j] || resp.cidades[i].id_cidade != q.cidades[j]) continue;
+                    respostas[j] = resp.cidades[i];
+                    respondida[j] = 1;
+                    n_respondidas++;
+                    break;
+                }
+            }
+        }
+    }
+    close(r.sockfd);
+    if (n_respondidas < total) {
+        fprintf(stderr, "Consulta: %d de %d cidades sem resposta após %d tentativas\n", total - n_respondidas, total,
+                MAX_TENTATIVAS);
+        if (n_respondidas == 0) return 1;
+    }
 
-        pthread_mutex_lock(&lock_mission);
-        current_mission.ocupada = 0;
-        pthread_mutex_unlock(&lock_mission);
+    printf("[CONSULTA] %d capitais mais próximas\n", k);
+    for (int i = 0; i < total; i++) {
+        if (!respondida[i]) continue;
+        resposta_cidade_t *rc = &respostas[i];
+        int id = ntohl(rc->id_cidade);
+        int achadas = ntohl(rc->total);
+        if (id < 0 || id >= n_cidades || achadas < 0 || achadas > CONSULTA_MAX_K) continue;
+        printf("%s (ID=%d)\n", cidades[id]._nome, id);
+        if (achadas == 0) printf("   nenhuma capital alcançável\n");
+        for (int j = 0; j < achadas; j++) {
+            int cap = ntohl(rc->capitais[j].id_capital);
+            if (cap < 0 || cap >= n_cidades) continue;
+            printf("   %d. %s (ID=%d) %d km, %d/%d drones livres\n", j + 1, cidades[cap]._nome, cap,
+                   (int)ntohl(rc->capitais[j].distancia), (int)ntohl(rc->capitais[j].livres),
+                   (int)ntohl(rc->capitais[j].frota));
+        }
     }
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Uso: %s v4|v6\n", argv[0]);
+    const char *uso = "Uso: %s v4|v6 [-n reatores] [-a] [-j prefixo_journal] [-g regiao.txt ...]\n"
+                      "       %s v4|v6 -q id_cidade[,id_cidade...] [-k capitais] [-g regiao.txt ...]\n";
+    if (argc < 2) {
+        fprintf(stderr, uso, argv[0], argv[0]);
         return 1;
     }
 
-    FILE *f = fopen("grafo_amazonia_legal.txt", "r");
-    if (!f) {
-        perror("Erro ao abrir arquivo");
-        return 1;
+    int n_reatores = 1;
+    const char *consulta = NULL;
+    int k_consulta = 3;
+    const char *grafos[MAX_REGIOES];
+    int n_grafos = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            n_reatores = atoi(argv[++i]);
+            if (n_reatores < 1 || n_reatores > MAX_REATORES) {
+                fprintf(stderr, "Número de reatores deve estar entre 1 e %d\n", MAX_REATORES);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-a") == 0) {
+            adaptativo = 1;
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            consulta = argv[++i];
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            k_consulta = atoi(argv[++i]);
+            if (k_consulta < 1 || k_consulta > CONSULTA_MAX_K) {
+                fprintf(stderr, "k deve estar entre 1 e %d\n", CONSULTA_MAX_K);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            prefixo_journal = argv[++i];
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc && n_grafos < MAX_REGIOES) {
+            grafos[n_grafos++] = argv[++i];
+        } else {
+            fprintf(stderr, uso, argv[0], argv[0]);
+            return 1;
+        }
     }
 
-    Cidade *cidades = ler_arquivo(f);
-    fclose(f);
+    // mesmas regiões, na mesma ordem, passadas ao servidor com -r
+    if (n_grafos == 0) grafos[n_grafos++] = "grafo_amazonia_legal.txt";
+    Cidade *cidades = NULL;
+    for (int i = 0; i < n_grafos; i++) {
+        FILE *f = fopen(grafos[i], "r");
+        if (!f) {
+            perror("Erro ao abrir arquivo");
+            return 1;
+        }
+        cidades = ler_arquivo(f, cidades);
+        fclose(f);
+    }
 
     char *protocolo = argv[1];
     int porta = 8080;
 
     if (strcmp(protocolo, "v4") == 0) {
         usa_ipv4 = 1;
-        sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-        if (sockfd < 0) { perror("socket"); return 1; }
         memset(&addr4, 0, sizeof(addr4));
         addr4.sin_family = AF_INET;
         addr4.sin_port = htons(porta);
@@ -388,8 +932,6 @@ int main(int argc, char *argv[]) {
         printf("Conectado ao servidor 127.0.0.1:%d\n\n", porta);
     } else {
         usa_ipv4 = 0;
-        sockfd = socket(AF_INET6, SOCK_DGRAM, 0);
-        if (sockfd < 0) { perror("socket"); return 1; }
         memset(&addr6, 0, sizeof(addr6));
         addr6.sin6_family = AF_INET6;
         addr6.sin6_port = htons(porta);
@@ -397,33 +939,44 @@ int main(int argc, char *argv[]) {
         printf("Conectado ao servidor ::1:%d\n\n", porta);
     }
 
-    pthread_mutex_lock(&lock);
-    ultima_telemetria.total = 0;
-    pthread_mutex_unlock(&lock);
+    if (consulta) {
+        int rc = consulta_capitais(cidades, consulta, k_consulta);
+        free(cidades);
+        return rc;
+    }
 
-    current_mission.ativa = 0;
-    current_mission.ocupada = 0;
+    reator_t *reatores = calloc(n_reatores, sizeof(reator_t));
+    for (int i = 0; i < n_reatores; i++) {
+        if (cria_reator(&reatores[i], i, cidades) < 0) return 1;
+    }
 
-    printf("Iniciando threads...\n\n");
-    printf("[ Thread Monitoramento ] Iniciada\n");
-    printf("[ Thread Simulação Drones ] Iniciada\n");
-    printf("[ Thread Telemetria ] Iniciada\n");
-    printf("[ Thread Recepção Drones ] Iniciada\n");
-    printf(". Todas as threads iniciadas com sucesso\n");
+    printf("Iniciando %d reator(es)...\n\n", n_reatores);
+    printf("[ Amostragem ] a cada %d s\n", INTERVALO_AMOSTRAGEM);
+    if (adaptativo) {
+        printf("[ Telemetria ] adaptativa: alertas imediatos, heartbeat de %d a %d s\n",
+               INTERVALO_TELEMETRIA, INTERVALO_TELEMETRIA_MAX);
+    } else {
+        printf("[ Telemetria ] a cada %d s\n", INTERVALO_TELEMETRIA);
+    }
+    printf(". Reatores iniciados com sucesso\n");
     printf("Pressione Ctrl+C para encerrar...\n");
 
-    pthread_t t1, t2, trecv, t4;
-    pthread_create(&t1, NULL, thread_monitoramento, (void *)cidades);
-    pthread_create(&t2, NULL, thread_envia_telemetria, (void *)cidades);
-    pthread_create(&trecv, NULL, thread_recebe, (void *)cidades);
-    pthread_create(&t4, NULL, thread_atuacao, (void *)cidades);
-
-    pthread_join(t1, NULL);
-    pthread_join(t2, NULL);
-    pthread_join(trecv, NULL);
-    pthread_join(t4, NULL);
+    // o primeiro reator roda na thread principal; os demais em threads próprias
+    pthread_t threads[MAX_REATORES];
+    for (int i = 1; i < n_reatores; i++) {
+        pthread_create(&threads[i], NULL, executa_reator, &reatores[i]);
+    }
+    executa_reator(&reatores[0]);
+    for (int i = 1; i < n_reatores; i++) {
+        pthread_join(threads[i], NULL);
+    }
 
+    for (int i = 0; i < n_reatores; i++) {
+        close(reatores[i].sockfd);
+        close(reatores[i].epfd);
+        free(reatores[i].missoes);
+    }
+    free(reatores);
     free(cidades);
-    close(sockfd);
     return 0;
-}
\ No newline at end of file
+}
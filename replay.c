@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define MSG_TELEMETRIA 1
+#define MSG_ACK 2
+#define MSG_EQUIPE_DRONE 3
+#define MSG_CONCLUSAO 4
+#define MSG_ALERTA 5
+
+#define MAX_PARES 256
+#define MAX_REGIOES 16
+#define JANELA 32           // mensagens aguardando resposta no modo rápido
+#define ESPERA_FINAL_MS 500 // silêncio que encerra a coleta de respostas
+
+/*
+ Reproduz um trace gravado com "server ... -c arquivo" contra um servidor em
+ localhost: cada par original ganha um socket próprio, os datagramas recebidos
+ pelo servidor são reenviados na ordem original (no tempo original com -t ou o
+ mais rápido possível) e as ordens de drone devolvidas são comparadas, por par,
+ com as que o servidor gravado enviou.
+ O servidor precisa partir do mesmo estado da captura (sem journal antigo).
+ Com regiões (-r, os mesmos arquivos e na mesma ordem do servidor) a ordem
+ entre regiões não é determinística: a comparação é feita por par e por
+ região da capital que despachou, e cada datagrama só sai depois da resposta
+ do anterior (o ACK de uma parte dividida cobre também os repasses que ela
+ gerou), para que cada região veja seus eventos na ordem da captura.
+ */
+
+typedef struct {
+    uint16_t tipo;
+    uint16_t tamanho;
+} header_t;
+
+typedef struct {
+    int id_cidade;
+    int id_equipe;
+} payload_equipe_drone_t;
+
+#define TRACE_MAGICA 0x55445054 // "UDPT"
+#define TRACE_VERSAO 1
+
+typedef struct {
+    uint32_t magica;
+    uint32_t versao;
+} cabecalho_trace_t;
+
+typedef struct {
+    uint64_t t_ns;       // CLOCK_MONOTONIC desde o início da captura
+    uint8_t direcao;     // 0 = recebido pelo servidor, 1 = enviado pelo servidor
+    uint8_t familia;     // 4 ou 6
+    uint16_t porta;      // network order
+    uint8_t endereco[16];
+    uint16_t len;
+    uint16_t reservado;
+} registro_trace_t;
+
+typedef struct {
+    registro_trace_t r;
+    uint8_t *dados;
+    int par;
+} datagrama_t;
+
+typedef struct {
+    int id_cidade;
+    int id_equipe;
+} despacho_t;
+
+/* um par (endereço:porta) visto na captura */
+typedef struct {
+    uint8_t familia;
+    uint16_t porta;
+    uint8_t endereco[16];
+    int sockfd;
+    despacho_t *esperados;
+    int n_esperados;
+    despacho_t *obtidos;
+    int n_obtidos;
+    int cap_obtidos;
+} par_t;
+
+par_t pares[MAX_PARES];
+int n_pares = 0;
+int offsets[MAX_REGIOES + 1]; // região i: ids [offsets[i], offsets[i + 1])
+int n_regioes = 0;
+int aguardando = 0; // datagramas enviados que ainda devem uma resposta
+long respostas = 0;
+
+int acha_par(registro_trace_t *r) {
+    for (int i = 0; i < n_pares; i++) {
+        if (pares[i].familia == r->familia && pares[i].porta == r->porta &&
+            memcmp(pares[i].endereco, r->endereco, sizeof(r->endereco)) == 0) {
+            return i;
+        }
+    }
+    if (n_pares == MAX_PARES) return -1;
+    par_t *p = &pares[n_pares];
+    memset(p, 0, sizeof(*p));
+    p->familia = r->familia;
+    p->porta = r->porta;
+    memcpy(p->endereco, r->endereco, sizeof(p->endereco));
+    p->sockfd = -1;
+    return n_pares++;
+}
+
+/* lê o trace inteiro para a memória */
+datagrama_t *le_trace(const char *caminho, int *total) {
+    FILE *f = fopen(caminho, "rb");
+    if (!f) {
+        perror("Erro abrindo trace");
+        return NULL;
+    }
+    cabecalho_trace_t c;
+    if (fread(&c, sizeof(c), 1, f) != 1 || c.magica != TRACE_MAGICA || c.versao != TRACE_VERSAO) {
+        fprintf(stderr, "%s não é um trace válido\n", caminho);
+        fclose(f);
+        return NULL;
+    }
+
+    int cap = 1024, n = 0;
+    datagrama_t *d = malloc(cap * sizeof(datagrama_t));
+    registro_trace_t r;
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        uint8_t *dados = malloc(r.len ? r.len : 1);
+        if (fread(dados, 1, r.len, f) != r.len) {
+            free(dados);
+            break; // registro truncado no fim do arquivo
+        }
+        if (n == cap) {
+            cap *= 2;
+            d = realloc(d, cap * sizeof(datagrama_t));
+        }
+        d[n].r = r;
+        d[n].dados = dados;
+        d[n].par = acha_par(&r);
+        if (d[n].par < 0) {
+            fprintf(stderr, "Trace com mais de %d pares\n", MAX_PARES);
+            fclose(f);
+            return NULL;
+        }
+        n++;
+    }
+    fclose(f);
+    *total = n;
+    return d;
+}
+
+void adiciona_despacho(despacho_t **v, int *n, int *cap, int id_cidade, int id_equipe) {
+    if (*n == *cap) {
+        *cap = *cap ? *cap * 2 : 16;
+        *v = realloc(*v, *cap * sizeof(despacho_t));
+    }
+    (*v)[*n].id_cidade = id_cidade;
+    (*v)[*n].id_equipe = id_equipe;
+    (*n)++;
+}
+
+/* extrai (cidade, equipe) de um MSG_EQUIPE_DRONE; 0 se não for um */
+int le_despacho(const uint8_t *buf, size_t len, despacho_t *out) {
+    if (len < sizeof(header_t) + sizeof(payload_equipe_drone_t)) return 0;
+    header_t h;
+    memcpy(&h, buf, sizeof(h));
+    if (ntohs(h.tipo) != MSG_EQUIPE_DRONE) return 0;
+    payload_equipe_drone_t p;
+    memcpy(&p, buf + sizeof(h), sizeof(p));
+    out->id_cidade = ntohl(p.id_cidade);
+    out->id_equipe = ntohl(p.id_equipe);
+    return 1;
+}
+
+/* o servidor responde com ACK a telemetria, alerta e conclusão */
+int espera_resposta(const uint8_t *buf, size_t len) {
+    if (len < sizeof(header_t)) return 0;
+    header_t h;
+    memcpy(&h, buf, sizeof(h));
+    uint16_t tipo = ntohs(h.tipo);
+    return tipo == MSG_TELEMETRIA || tipo == MSG_ALERTA || tipo == MSG_CONCLUSAO;
+}
+
+/* recebe o que houver nos sockets dos pares por até timeout_ms */
+int coleta_respostas(int timeout_ms) {
+    struct pollfd pfds[MAX_PARES];
+    for (int i = 0; i < n_pares; i++) {
+        pfds[i].fd = pares[i].sockfd;
+        pfds[i].events = POLLIN;
+    }
+    int rc = poll(pfds, n_pares, timeout_ms);
+    if (rc <= 0) return 0;
+
+    int recebidas = 0;
+    for (int i = 0; i < n_pares; i++) {
+        if (!(pfds[i].revents & POLLIN)) continue;
+        uint8_t buf[4096];
+        ssize_t len;
+        while ((len = recv(pares[i].sockfd, buf, sizeof(buf), MSG_DONTWAIT)) >= 0) {
+            recebidas++;
+            respostas++;
+            despacho_t d;
+            if (le_despacho(buf, (size_t)len, &d)) {
+                adiciona_despacho(&pares[i].obtidos, &pares[i].n_obtidos, &pares[i].cap_obtidos,
+                                  d.id_cidade, d.id_equipe);
+            } else if (aguardando > 0) {
+                aguardando--;
+            }
+        }
+    }
+    return recebidas;
+}
+
+/* região da capital (0 sem -r) */
+int regiao_de(int id_equipe) {
+    for (int i = 0; i < n_regioes; i++) {
+        if (id_equipe >= offsets[i] && id_equipe < offsets[i + 1]) return i;
+    }
+    return 0;
+}
+
+/* compara em ordem os despachos do par vindos da região; retorna as divergências */
+int compara_regiao(int i, int regiao, int divergencias) {
+    par_t *p = &pares[i];
+    int ke = 0, ko = 0, k = 0, novas = 0;
+    while (1) {
+        while (ke < p->n_esperados && regiao_de(p->esperados[ke].id_equipe) != regiao) ke++;
+        while (ko < p->n_obtidos && regiao_de(p->obtidos[ko].id_equipe) != regiao) ko++;
+        despacho_t *e = ke < p->n_esperados ? &p->esperados[ke++] : NULL;
+        despacho_t *o = ko < p->n_obtidos ? &p->obtidos[ko++] : NULL;
+        if (!e && !o) break;
+        k++;
+        if (e && o && e->id_cidade == o->id_cidade && e->id_equipe == o->id_equipe) continue;
+        if (divergencias + novas < 10) {
+            printf("DIVERGÊNCIA par %d", i);
+            if (n_regioes > 0) printf(" região %d", regiao);
+            printf(" ordem %d: esperado ", k - 1);
+            if (e) printf("cidade %d -> equipe %d", e->id_cidade, e->id_equipe);
+            else printf("nada");
+            printf(", obtido ");
+            if (o) printf("cidade %d -> equipe %d\n", o->id_cidade, o->id_equipe);
+            else printf("nada\n");
+        }
+        novas++;
+    }
+    return novas;
+}
+
+double agora_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    const char *uso = "Uso: %s arquivo_trace v4|v6 [-t] [-r regiao.txt ...]\n"
+                      "  -t  reproduz no tempo original (padrão: o mais rápido possível)\n"
+                      "  -r  regiões do servidor: compara os despachos por região\n";
+    if (argc < 3) {
+        fprintf(stderr, uso, argv[0]);
+        return 1;
+    }
+    int tempo_real = 0;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0) {
+            tempo_real = 1;
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc && n_regioes < MAX_REGIOES) {
+            // só o cabeçalho "N M" interessa: define o intervalo de ids da região
+            FILE *f = fopen(argv[++i], "r");
+            int N, M;
+            if (!f || fscanf(f, "%d %d", &N, &M) != 2) {
+                fprintf(stderr, "Erro lendo região %s\n", argv[i]);
+                return 1;
+            }
+            fclose(f);
+            offsets[n_regioes + 1] = offsets[n_regioes] + N;
+            n_regioes++;
+        } else {
+            fprintf(stderr, uso, argv[0]);
+            return 1;
+        }
+    }
+    int usa_ipv4 = strcmp(argv[2], "v4") == 0;
+    int porta = 8080;
+
+    int total;
+    datagrama_t *d = le_trace(argv[1], &total);
+    if (!d) return 1;
+
+    // respostas gravadas: as ordens de drone que cada par recebeu
+    int n_entrada = 0;
+    int cap_esperados[MAX_PARES] = { 0 };
+    for (int i = 0; i < total; i++) {
+        despacho_t desp;
+        if (d[i].r.direcao == 0) {
+            n_entrada++;
+        } else if (le_despacho(d[i].dados, d[i].r.len, &desp)) {
+            par_t *p = &pares[d[i].par];
+            adiciona_despacho(&p->esperados, &p->n_esperados, &cap_esperados[d[i].par],
+                              desp.id_cidade, desp.id_equipe);
+        }
+    }
+
+    struct sockaddr_in addr4;
+    struct sockaddr_in6 addr6;
+    memset(&addr4, 0, sizeof(addr4));
+    memset(&addr6, 0, sizeof(addr6));
+    addr4.sin_family = AF_INET;
+    addr4.sin_port = htons(porta);
+    inet_pton(AF_INET, "127.0.0.1", &addr4.sin_addr);
+    addr6.sin6_family = AF_INET6;
+    addr6.sin6_port = htons(porta);
+    inet_pton(AF_INET6, "::1", &addr6.sin6_addr);
+
+    for (int i = 0; i < n_pares; i++) {
+        pares[i].sockfd = socket(usa_ipv4 ? AF_INET : AF_INET6, SOCK_DGRAM, 0);
+        if (pares[i].sockfd < 0) {
+            perror("socket");
+            return 1;
+        }
+        int rcvbuf = 1 << 20;
+        setsockopt(pares[i].sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        int rc = usa_ipv4 ? connect(pares[i].sockfd, (struct sockaddr *)&addr4, sizeof(addr4))
+                          : connect(pares[i].sockfd, (struct sockaddr *)&addr6, sizeof(addr6));
+        if (rc < 0) {
+            perror("connect");
+            return 1;
+        }
+    }
+
+    printf("Trace %s: %d datagramas (%d recebidos pelo servidor), %d pares\n",
+           argv[1], total, n_entrada, n_pares);
+    printf("Reproduzindo %s...\n", tempo_real ? "no tempo original" : "o mais rápido possível");
+
+    struct timespec inicio;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    double t0 = agora_s();
+    uint64_t t_base = 0;
+    int primeiro = 1;
+    for (int i = 0; i < total; i++) {
+        if (d[i].r.direcao != 0) continue;
+        if (primeiro) {
+            t_base = d[i].r.t_ns;
+            primeiro = 0;
+        }
+
+        // com regiões: um datagrama por vez, mesmo no tempo original
+        int janela = n_regioes > 0 ? 1 : JANELA;
+        if (tempo_real) {
+            uint64_t alvo_ns = (uint64_t)inicio.tv_sec * 1000000000ull + inicio.tv_nsec + (d[i].r.t_ns - t_base);
+            struct timespec alvo = { (time_t)(alvo_ns / 1000000000ull), (long)(alvo_ns % 1000000000ull) };
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &alvo, NULL) == EINTR) {
+            }
+        }
+        if (!tempo_real || n_regioes > 0) {
+            // controle de fluxo: não deixa o socket do servidor transbordar
+            while (aguardando >= janela) {
+                if (coleta_respostas(ESPERA_FINAL_MS) == 0) aguardando = 0;
+            }
+        }
+
+        if (send(pares[d[i].par].sockfd, d[i].dados, d[i].r.len, 0) < 0) {
+            perror("send");
+            continue;
+        }
+        if (espera_resposta(d[i].dados, d[i].r.len)) aguardando++;
+        coleta_respostas(0);
+    }
+    double t_envio = agora_s() - t0;
+    while (coleta_respostas(ESPERA_FINAL_MS) > 0) {
+    }
+
+    printf("\n[RESULTADO]\n");
+    printf("Enviados : %d datagramas em %.3f s (%.0f datagramas/s)\n",
+           n_entrada, t_envio, t_envio > 0 ? n_entrada / t_envio : 0.0);
+    printf("Respostas: %ld\n", respostas);
+
+    int esperados = 0, obtidos = 0, divergencias = 0;
+    for (int i = 0; i < n_pares; i++) {
+        par_t *p = &pares[i];
+        esperados += p->n_esperados;
+        obtidos += p->n_obtidos;
+        for (int r = 0; r < (n_regioes > 0 ? n_regioes : 1); r++) {
+            divergencias += compara_regiao(i, r, divergencias);
+        }
+    }
+    printf("Despachos: %d esperados, %d obtidos, %d divergências\n", esperados, obtidos, divergencias);
+    printf(divergencias == 0 ? "-> OK: decisões de despacho idênticas\n" : "-> FALHA: decisões de despacho divergem\n");
+
+    for (int i = 0; i < n_pares; i++) {
+        close(pares[i].sockfd);
+        free(pares[i].esperados);
+        free(pares[i].obtidos);
+    }
+    for (int i = 0; i < total; i++) free(d[i].dados);
+    free(d);
+    return divergencias == 0 ? 0 : 1;
+}
@@ -6,11 +6,26 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <sys/wait.h>
 
 #define MSG_TELEMETRIA 1
 #define MSG_ACK 2
 #define MSG_EQUIPE_DRONE 3
 #define MSG_CONCLUSAO 4
+#define MSG_ALERTA 5 // só as cidades que mudaram de estado (payload_telemetria_t truncado)
+#define MSG_CONSULTA 6 // k capitais mais próximas de um lote de cidades (somente leitura)
+#define MSG_RESPOSTA_CONSULTA 7
+
+#define CONSULTA_MAX_CIDADES 16
+#define CONSULTA_MAX_K 5
+
+#define ROTA_MAX 64        // cidades por rota (capital ... cidade em alerta)
+#define ROTA_CACHE_TAM 64  // rotas codificadas mantidas no cache LRU
 
 /*
  estruturas disponibilizadas no enunciado
@@ -31,14 +46,51 @@ typedef struct {
 } payload_telemetria_t;
 
 typedef struct {
-    int status; // 0=ACK TELEMETRIA, 1=ACK EQUIPE, 2=ACK CONCLUSÃO
+    int status; // 0=ACK TELEMETRIA, 1=ACK EQUIPE, 2=ACK CONCLUSÃO, 3=ACK ALERTA
 } payload_ack_t;
 
+/* ACK de conclusão identifica a missão (clientes antigos leem só o status) */
+typedef struct {
+    int status;
+    int id_cidade;
+    int id_equipe;
+} payload_ack_conclusao_t;
+
 typedef struct {
     int id_cidade;
     int id_equipe;
 } payload_equipe_drone_t;
 
+/* vai logo depois de payload_equipe_drone_t; total = 0 se não houver rota */
+typedef struct {
+    int total;
+    int cidades[ROTA_MAX];
+} payload_rota_t;
+
+typedef struct {
+    int k;
+    int total;
+    int cidades[CONSULTA_MAX_CIDADES];
+} payload_consulta_t;
+
+typedef struct {
+    int id_capital;
+    int distancia;
+    int livres; // drones disponíveis agora
+    int frota;  // drones da capital
+} capital_proxima_t;
+
+typedef struct {
+    int id_cidade;
+    int total; // capitais alcançáveis devolvidas (<= k)
+    capital_proxima_t capitais[CONSULTA_MAX_K];
+} resposta_cidade_t;
+
+typedef struct {
+    int total;
+    resposta_cidade_t cidades[CONSULTA_MAX_CIDADES];
+} payload_resposta_consulta_t;
+
 typedef struct {
     int id_cidade;
     time_t timestamp;
@@ -48,6 +100,9 @@ typedef struct {
 alerta_t alertas[100];
 int total_alertas = 0;
 
+/* Variável para mostrar qual alerta foi o último enviado (heurística simples) */
+int last_sent_alert = -1;
+
 /* Grafo */
 typedef struct Edge {
     int to;
@@ -60,7 +115,8 @@ typedef struct Node {
     char _nome[100];
     int _tipo;
     int _status;
-    int _ocupada;
+    int _frota;         // drones da capital (coluna opcional do arquivo, padrão 1)
+    atomic_int _livres; // drones disponíveis
     Edge *_adj;
     int _grau;
 } Node;
@@ -88,64 +144,529 @@ void adiciona_aresta(Grafo *g, int u, int v, int p) {
     g->nodes[v]._grau++;
 }
 
-Grafo *cria_grafo(FILE *f) {
-    int N, M;
-    fscanf(f, "%d %d", &N, &M);
-    fgetc(f);
+Grafo *aloca_grafo(int N) {
     Grafo *g = malloc(sizeof(Grafo));
     g->n = N;
-    g->m = M;
+    g->m = 0;
     g->nodes = malloc(N * sizeof(Node));
     for (int i = 0; i < N; i++) {
         g->nodes[i]._idx = i;
         g->nodes[i]._nome[0] = '\0';
         g->nodes[i]._tipo = -1;
         g->nodes[i]._status = 0;
-        g->nodes[i]._ocupada = 0;
+        g->nodes[i]._frota = 0;
+        atomic_init(&g->nodes[i]._livres, 0);
         g->nodes[i]._adj = NULL;
         g->nodes[i]._grau = 0;
     }
+    return g;
+}
 
+/* lê as N cidades e as M arestas de f para g a partir de offset; uma região
+   de outro shard (propria == 0) contribui só com os nomes */
+void le_cidades_arestas(Grafo *g, FILE *f, int N, int M, int offset, int propria) {
     char linha[256];
-    int idx, tipo;
+    int idx, tipo, frota;
     char nome[200];
     for (int k = 0; k < N; k++) {
         fgets(linha, sizeof(linha), f);
-        sscanf(linha, "%d %[^0-9] %d", &idx, nome, &tipo);
+        // "id nome tipo [frota]"
+        int campos = sscanf(linha, "%d %[^0-9] %d %d", &idx, nome, &tipo, &frota);
         int len = strlen(nome);
         if (len > 0 && nome[len - 1] == ' ') nome[len - 1] = '\0';
+        idx += offset;
         g->nodes[idx]._idx = idx;
         strcpy(g->nodes[idx]._nome, nome);
-        g->nodes[idx]._tipo = tipo;
+        g->nodes[idx]._tipo = propria ? tipo : 0;
+        if (propria && tipo == 1) {
+            g->nodes[idx]._frota = (campos == 4 && frota > 0) ? frota : 1;
+            atomic_store(&g->nodes[idx]._livres, g->nodes[idx]._frota);
+        }
     }
+    if (!propria) return;
 
+    g->m = M;
     for (int i = 0; i < M; i++) {
         int u, v, p;
         fscanf(f, "%d %d %d", &u, &v, &p);
-        adiciona_aresta(g, u, v, p);
+        adiciona_aresta(g, offset + u, offset + v, p);
     }
+}
 
+Grafo *cria_grafo(FILE *f) {
+    int N, M;
+    fscanf(f, "%d %d", &N, &M);
+    fgetc(f);
+    Grafo *g = aloca_grafo(N);
+    le_cidades_arestas(g, f, N, M, 0, 1);
     return g;
 }
 
-/* registrar alerta */
-void registrar_alerta(int id_cidade) {
-    if (total_alertas >= 100) return;
-    alerta_t *a = &alertas[total_alertas++];
+/*
+ Journal (opcional, -j prefixo): cada mudança de estado vira um registro em
+ prefixo.log. Os registros ficam em memória e são gravados com um único
+ fdatasync quando o socket esvazia ou o lote enche (group commit); as respostas
+ geradas nesse meio tempo esperam na fila de saída até o commit. A cada
+ JOURNAL_SNAPSHOT registros o estado inteiro vai para prefixo.snap e o log é
+ truncado; na partida carrega-se o snapshot e reaplica-se o resto do log.
+ */
+#define JOURNAL_LOTE 64
+#define JOURNAL_SNAPSHOT 1024
+#define JOURNAL_MAGICA 0x4a524e32 // "JRN2"
+#define SAIDA_MAX 128
+
+enum { JR_STATUS = 1, JR_ALERTA, JR_DESPACHO, JR_ACK, JR_CONCLUSAO };
+
+typedef struct {
+    uint64_t seq;
+    int64_t timestamp;
+    int32_t tipo;
+    int32_t id_cidade;
+    int32_t id_equipe;
+    int32_t valor; // status (JR_STATUS) ou índice do alerta (JR_DESPACHO/JR_ACK)
+} registro_journal_t;
+
+typedef struct {
+    uint32_t magica;
+    int32_t n;
+    uint64_t seq;
+    int32_t total_alertas;
+    int32_t last_sent_alert;
+} cabecalho_snapshot_t;
+
+typedef struct {
+    uint8_t buf[2048];
+    size_t len;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    uint32_t lote; // != 0: confirmação de lote para o roteador em vez de datagrama
+} saida_t;
+
+typedef struct {
+    int fd; // -1 = journal desligado
+    char caminho_log[256];
+    char caminho_snap[256];
+    uint64_t seq;
+    int desde_snapshot;
+    registro_journal_t lote[JOURNAL_LOTE];
+    int n_lote;
+    int sockfd;
+    saida_t saidas[SAIDA_MAX];
+    int n_saidas;
+} journal_t;
+
+journal_t journal = { .fd = -1 };
+
+/*
+ Captura (opcional, -c arquivo): todo datagrama recebido e enviado vai para um
+ trace binário com instante monotônico e endereço do par, para ser reproduzido
+ pelo replay.
+ */
+#define TRACE_MAGICA 0x55445054 // "UDPT"
+#define TRACE_VERSAO 1
+
+typedef struct {
+    uint32_t magica;
+    uint32_t versao;
+} cabecalho_trace_t;
+
+typedef struct {
+    uint64_t t_ns;       // CLOCK_MONOTONIC desde o início da captura
+    uint8_t direcao;     // 0 = recebido pelo servidor, 1 = enviado pelo servidor
+    uint8_t familia;     // 4 ou 6
+    uint16_t porta;      // network order
+    uint8_t endereco[16];
+    uint16_t len;
+    uint16_t reservado;
+} registro_trace_t;
+
+FILE *trace = NULL;
+struct timespec trace_inicio;
+
+int captura_abre(const char *caminho) {
+    trace = fopen(caminho, "wb");
+    if (!trace) {
+        perror("captura");
+        return -1;
+    }
+    setvbuf(trace, NULL, _IOFBF, 1 << 20);
+    cabecalho_trace_t c = { TRACE_MAGICA, TRACE_VERSAO };
+    fwrite(&c, sizeof(c), 1, trace);
+    clock_gettime(CLOCK_MONOTONIC, &trace_inicio);
+    printf("Capturando datagramas em %s\n", caminho);
+    return 0;
+}
+
+void captura_registra(int direcao, struct sockaddr_storage *addr, const void *buf, size_t len) {
+    if (!trace) return;
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    registro_trace_t r;
+    memset(&r, 0, sizeof(r));
+    r.t_ns = (uint64_t)(agora.tv_sec - trace_inicio.tv_sec) * 1000000000ull + agora.tv_nsec - trace_inicio.tv_nsec;
+    r.direcao = (uint8_t)direcao;
+    if (addr->ss_family == AF_INET) {
+        struct sockaddr_in *a4 = (struct sockaddr_in *)addr;
+        r.familia = 4;
+        r.porta = a4->sin_port;
+        memcpy(r.endereco, &a4->sin_addr, 4);
+    } else {
+        struct sockaddr_in6 *a6 = (struct sockaddr_in6 *)addr;
+        r.familia = 6;
+        r.porta = a6->sin6_port;
+        memcpy(r.endereco, &a6->sin6_addr, 16);
+    }
+    r.len = (uint16_t)len;
+    fwrite(&r, sizeof(r), 1, trace);
+    fwrite(buf, 1, len, trace);
+}
+
+/*
+ Shards (opcional, -r regiao.txt repetido): um processo por região, cada um
+ com seu Grafo, alertas, frotas e journal. O processo principal (roteador)
+ faz todo o I/O UDP e a captura e troca envelopes com os shards por
+ socketpairs locais; repasses de alerta entre regiões também passam por ele.
+ Os ids de cidade são globais: a região i ocupa [offset, offset + n).
+ Telemetria e alerta divididos entre regiões são confirmados pelo roteador:
+ cada shard devolve um ENV_CONFIRMA depois do commit da sua parte e o ACK só
+ sai quando todas as partes do lote estão no disco. Um repasse entre regiões
+ leva o lote do datagrama que o gerou e também precisa ser confirmado, então o
+ ACK só sai depois de toda a cadeia de repasses.
+ */
+#define SHARDS_MAX 16
+
+enum { ENV_DATAGRAMA = 1, ENV_HANDOFF, ENV_CONFIRMA };
+
+typedef struct {
+    int tipo;          // ENV_*
+    int destino;       // shard destino de um ENV_HANDOFF
+    uint32_t lote;     // parte de um datagrama dividido (0 = nenhum): o roteador responde o ACK
+    socklen_t addr_len;
+    struct sockaddr_storage addr;
+    uint32_t len;      // bytes que seguem o envelope
+} envelope_t;
+
+typedef struct {
+    char arquivo[256];
+    int offset;
+    int n;
+    int fd;  // lado do roteador do socketpair
+    int ipc; // lado do shard
+} regiao_t;
+
+regiao_t regioes[SHARDS_MAX];
+int n_regioes = 0;
+int shard_id = -1;   // -1 = processo único ou roteador
+int ipc_fd = -1;     // lado do shard do socketpair
+uint32_t lote_atual = 0; // lote do envelope em processamento (0 = ACK respondido aqui)
+
+/* região dona da cidade (pelo intervalo de ids) */
+int dono_cidade(int id) {
+    for (int i = 0; i < n_regioes; i++) {
+        if (id >= regioes[i].offset && id < regioes[i].offset + regioes[i].n) return i;
+    }
+    return -1;
+}
+
+ssize_t envia_envelope(int fd, envelope_t *env, const void *dados, size_t len) {
+    uint8_t buf[sizeof(envelope_t) + 8192];
+    if (len > sizeof(buf) - sizeof(envelope_t)) return -1;
+    env->len = (uint32_t)len;
+    memcpy(buf, env, sizeof(*env));
+    if (len > 0) memcpy(buf + sizeof(*env), dados, len);
+    return send(fd, buf, sizeof(*env) + len, 0);
+}
+
+/* envia ao cliente: direto pelo socket UDP ou, num shard, via roteador */
+ssize_t envia_ao_cliente(int sockfd, struct sockaddr_storage *addr, socklen_t addr_len, const void *buf, size_t len) {
+    if (ipc_fd >= 0) {
+        envelope_t env;
+        memset(&env, 0, sizeof(env));
+        env.tipo = ENV_DATAGRAMA;
+        env.addr = *addr;
+        env.addr_len = addr_len;
+        return envia_envelope(ipc_fd, &env, buf, len) < 0 ? -1 : (ssize_t)len;
+    }
+    ssize_t sent = sendto(sockfd, buf, len, 0, (struct sockaddr *)addr, addr_len);
+    if (sent >= 0) captura_registra(1, addr, buf, len);
+    return sent;
+}
+
+/* avisa o roteador que a parte do lote deste shard está no disco */
+void confirma_lote(uint32_t lote) {
+    envelope_t env;
+    memset(&env, 0, sizeof(env));
+    env.tipo = ENV_CONFIRMA;
+    env.lote = lote;
+    if (envia_envelope(ipc_fd, &env, NULL, 0) < 0) perror("confirmação de lote");
+}
+
+/* grava o lote com um único fdatasync; as respostas só saem no journal_commit */
+void journal_grava(void) {
+    if (journal.fd < 0 || journal.n_lote == 0) return;
+    size_t bytes = journal.n_lote * sizeof(registro_journal_t);
+    if (write(journal.fd, journal.lote, bytes) != (ssize_t)bytes) perror("journal write");
+    if (fdatasync(journal.fd) < 0) perror("journal fdatasync");
+    journal.desde_snapshot += journal.n_lote;
+    journal.n_lote = 0;
+}
+
+/* toda resposta é enfileirada depois dos registros que ela cobre, então
+   gravar o lote e liberar a fila inteira é seguro em qualquer ponto */
+void journal_commit(void) {
+    if (journal.fd < 0) return;
+    journal_grava();
+    for (int i = 0; i < journal.n_saidas; i++) {
+        saida_t *o = &journal.saidas[i];
+        if (o->lote) {
+            confirma_lote(o->lote);
+        } else if (envia_ao_cliente(journal.sockfd, &o->addr, o->addr_len, o->buf, o->len) < 0) {
+            perror("sendto (fila de saída)");
+        }
+    }
+    journal.n_saidas = 0;
+}
+
+void journal_registra(int tipo, int id_cidade, int id_equipe, int valor, time_t timestamp) {
+    if (journal.fd < 0) return;
+    if (journal.n_lote == JOURNAL_LOTE) journal_grava(); // lote cheio: as respostas esperam o commit
+    registro_journal_t *r = &journal.lote[journal.n_lote++];
+    r->seq = ++journal.seq;
+    r->timestamp = timestamp;
+    r->tipo = tipo;
+    r->id_cidade = id_cidade;
+    r->id_equipe = id_equipe;
+    r->valor = valor;
+}
+
+/* com journal ligado a resposta só sai depois do commit do que a gerou */
+ssize_t envia_datagrama(int sockfd, struct sockaddr_storage *client_addr, socklen_t client_len, const void *buf, size_t len) {
+    if (journal.fd < 0) return envia_ao_cliente(sockfd, client_addr, client_len, buf, len);
+    if (len > sizeof(journal.saidas[0].buf)) return -1;
+    if (journal.n_saidas == SAIDA_MAX) journal_commit();
+    saida_t *o = &journal.saidas[journal.n_saidas++];
+    memcpy(o->buf, buf, len);
+    o->len = len;
+    memcpy(&o->addr, client_addr, client_len);
+    o->addr_len = client_len;
+    o->lote = 0;
+    journal.sockfd = sockfd;
+    return (ssize_t)len;
+}
+
+/* confirma a parte do lote quando o que ela gerou estiver no disco */
+void agenda_confirmacao(uint32_t lote) {
+    if (journal.fd < 0) {
+        confirma_lote(lote);
+        return;
+    }
+    if (journal.n_saidas == SAIDA_MAX) journal_commit();
+    saida_t *o = &journal.saidas[journal.n_saidas++];
+    o->len = 0;
+    o->lote = lote;
+}
+
+/* registrar alerta; com o vetor cheio reaproveita o alerta mais antigo sem
+   equipe atuando. Retorna o índice ou -1 se todos tiverem equipe */
+int registrar_alerta(int id_cidade, time_t timestamp) {
+    int idx = -1;
+    if (total_alertas < 100) {
+        idx = total_alertas++;
+    } else {
+        for (int i = 0; i < total_alertas && idx == -1; i++) {
+            if (alertas[i].equipe_atuando == -1) idx = i;
+        }
+        if (idx == -1) return -1;
+    }
+    alerta_t *a = &alertas[idx];
     a->id_cidade = id_cidade;
-    a->timestamp = time(NULL);
+    a->timestamp = timestamp;
     a->equipe_atuando = -1;
+    return idx;
+}
+
+/* retira um drone da capital se houver algum livre */
+int reserva_unidade(Node *capital) {
+    int livres = atomic_load(&capital->_livres);
+    while (livres > 0) {
+        if (atomic_compare_exchange_weak(&capital->_livres, &livres, livres - 1)) return 1;
+    }
+    return 0;
+}
+
+/* devolve exatamente um drone, sem passar da frota */
+int devolve_unidade(Node *capital) {
+    int livres = atomic_load(&capital->_livres);
+    while (livres < capital->_frota) {
+        if (atomic_compare_exchange_weak(&capital->_livres, &livres, livres + 1)) return 1;
+    }
+    return 0;
+}
+
+/* associa a equipe (cujo drone já foi reservado) ao alerta */
+void aplica_despacho(int id_equipe, int idx_alert) {
+    alertas[idx_alert].equipe_atuando = id_equipe;
+    last_sent_alert = idx_alert;
+}
+
+/* devolve o drone da missão e encerra o alerta; 0 se não houver missão
+   correspondente (conclusão repetida), e aí nada é devolvido */
+int aplica_conclusao(Grafo *g, int id_cidade, int id_equipe) {
+    // localizar alerta atendido por essa equipe
+    for (int i = 0; i < total_alertas; i++) {
+        if (alertas[i].id_cidade == id_cidade && alertas[i].equipe_atuando == id_equipe) {
+            alertas[i].equipe_atuando = -1;
+            devolve_unidade(&g->nodes[id_equipe]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* snapshot compacto: grava em .tmp, fsync, rename e só então trunca o log */
+void journal_snapshot(Grafo *g) {
+    if (journal.fd < 0) return;
+    journal_commit();
+
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", journal.caminho_snap);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        perror("snapshot");
+        return;
+    }
+    cabecalho_snapshot_t c = { JOURNAL_MAGICA, g->n, journal.seq, total_alertas, last_sent_alert };
+    int ok = fwrite(&c, sizeof(c), 1, f) == 1;
+    ok = ok && fwrite(alertas, sizeof(alerta_t), total_alertas, f) == (size_t)total_alertas;
+    for (int i = 0; i < g->n && ok; i++) {
+        int32_t st[2] = { g->nodes[i]._status, atomic_load(&g->nodes[i]._livres) };
+        ok = fwrite(st, sizeof(st), 1, f) == 1;
+    }
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    if (fclose(f) != 0) ok = 0;
+    // snapshot incompleto não substitui o anterior nem autoriza truncar o log
+    if (!ok) {
+        perror("snapshot");
+        unlink(tmp);
+        return;
+    }
+    if (rename(tmp, journal.caminho_snap) < 0) {
+        perror("snapshot rename");
+        unlink(tmp);
+        return;
+    }
+
+    // o rename só é durável depois do fsync do diretório
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s", journal.caminho_snap);
+    char *barra = strrchr(dir, '/');
+    if (barra) *(barra == dir ? barra + 1 : barra) = '\0';
+    else strcpy(dir, ".");
+    int dfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dfd < 0 || fsync(dfd) < 0) {
+        perror("snapshot fsync do diretório");
+        if (dfd >= 0) close(dfd);
+        return; // log mantido: a recuperação ignora os registros já no snapshot
+    }
+    close(dfd);
+
+    // registros com seq <= c.seq são ignorados na recuperação, então um crash
+    // entre o rename e o truncate não reaplica nada duas vezes
+    if (ftruncate(journal.fd, 0) < 0) perror("journal ftruncate");
+    journal.desde_snapshot = 0;
+}
+
+void journal_reaplica(Grafo *g, registro_journal_t *r) {
+    int cidade_ok = r->id_cidade >= 0 && r->id_cidade < g->n;
+    int equipe_ok = r->id_equipe >= 0 && r->id_equipe < g->n;
+    switch (r->tipo) {
+    case JR_STATUS:
+        if (cidade_ok) g->nodes[r->id_cidade]._status = r->valor;
+        break;
+    case JR_ALERTA:
+        if (cidade_ok) registrar_alerta(r->id_cidade, (time_t)r->timestamp);
+        break;
+    case JR_DESPACHO:
+        if (equipe_ok && r->valor >= 0 && r->valor < total_alertas) {
+            reserva_unidade(&g->nodes[r->id_equipe]);
+            aplica_despacho(r->id_equipe, r->valor);
+        }
+        break;
+    case JR_CONCLUSAO:
+        if (cidade_ok && equipe_ok) aplica_conclusao(g, r->id_cidade, r->id_equipe);
+        break;
+    default: // JR_ACK só fica para auditoria
+        break;
+    }
+}
+
+/* abre o journal e reconstrói o estado: snapshot + cauda do log */
+int journal_abre(Grafo *g, const char *prefixo) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    snprintf(journal.caminho_log, sizeof(journal.caminho_log), "%s.log", prefixo);
+    snprintf(journal.caminho_snap, sizeof(journal.caminho_snap), "%s.snap", prefixo);
+
+    uint64_t seq_snap = 0;
+    FILE *f = fopen(journal.caminho_snap, "rb");
+    if (f) {
+        cabecalho_snapshot_t c;
+        if (fread(&c, sizeof(c), 1, f) == 1 && c.magica == JOURNAL_MAGICA && c.n == g->n &&
+            c.total_alertas >= 0 && c.total_alertas <= 100) {
+            total_alertas = c.total_alertas;
+            last_sent_alert = c.last_sent_alert;
+            seq_snap = c.seq;
+            if (fread(alertas, sizeof(alerta_t), total_alertas, f) != (size_t)total_alertas) total_alertas = 0;
+            for (int i = 0; i < g->n; i++) {
+                int32_t st[2];
+                if (fread(st, sizeof(st), 1, f) != 1) break;
+                g->nodes[i]._status = st[0];
+                int livres = st[1] < 0 ? 0 : st[1] > g->nodes[i]._frota ? g->nodes[i]._frota : st[1];
+                atomic_store(&g->nodes[i]._livres, livres);
+            }
+        } else {
+            fprintf(stderr, "Snapshot %s inválido, ignorado\n", journal.caminho_snap);
+        }
+        fclose(f);
+    }
+
+    journal.fd = open(journal.caminho_log, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (journal.fd < 0) {
+        perror("journal open");
+        return -1;
+    }
+    journal.seq = seq_snap;
+    int reaplicados = 0;
+    off_t valido = 0;
+    registro_journal_t r;
+    while (read(journal.fd, &r, sizeof(r)) == (ssize_t)sizeof(r)) {
+        valido += sizeof(r);
+        if (r.seq <= journal.seq) continue;
+        journal_reaplica(g, &r);
+        journal.seq = r.seq;
+        reaplicados++;
+    }
+    // descarta registro parcial deixado por um crash no meio do write
+    if (ftruncate(journal.fd, valido) < 0) perror("journal ftruncate");
+    journal.desde_snapshot = reaplicados;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    printf("Journal %s: snapshot seq=%llu + %d registros reaplicados em %.3f ms\n",
+           prefixo, (unsigned long long)seq_snap, reaplicados, ms);
+    return 0;
 }
 
-/* Dijkstra: além de retornar índice da melhor equipe, retorna distância via out_dist */
-int dijkstra_escolhe_equipe(Grafo *g, int origem, int *out_dist) {
+/* Dijkstra a partir de origem; dist[i] = INT_MAX se i não for alcançável e
+   pai[i] = antecessor de i na árvore de caminhos mínimos (-1 na raiz) */
+void dijkstra_distancias(Grafo *g, int origem, int *dist, int16_t *pai) {
     int n = g->n;
-    int dist[n];
     int usado[n];
 
     for (int i = 0; i < n; i++) {
         dist[i] = INT_MAX;
         usado[i] = 0;
+        if (pai) pai[i] = -1;
     }
     dist[origem] = 0;
 
@@ -161,30 +682,149 @@ int dijkstra_escolhe_equipe(Grafo *g, int origem, int *out_dist) {
             int peso = e->peso;
             if (dist[v] != INT_MAX && dist[v] + peso < dist[u]) {
                 dist[u] = dist[v] + peso;
+                if (pai) pai[u] = (int16_t)v;
             }
         }
     }
+}
+
+/*
+ Floresta de caminhos mínimos: um Dijkstra por capital, feito uma vez na
+ partida (o grafo não muda). Para cada cidade guarda as capitais já ordenadas
+ por distância, então consultas e despachos não percorrem o grafo, e a árvore
+ de cada capital (vetor de pais) dá a rota até qualquer cidade.
+ */
+typedef struct {
+    int n_capitais;
+    int *capitais;   // id de cada capital
+    int *dist;       // dist[c * n + v] = distância da capital c até v
+    int16_t *pai;    // pai[c * n + v] = antecessor de v no caminho a partir da capital c
+    int *ordem;      // ordem[v * n_capitais + j] = j-ésima capital mais próxima de v
+} floresta_t;
+
+floresta_t floresta;
+
+Grafo *grafo_ordenacao;
+int cidade_ordenacao;
 
-    int melhor_idx = -1;
-    int melhor_dist = INT_MAX;
+int compara_capitais(const void *a, const void *b) {
+    int ca = *(const int *)a, cb = *(const int *)b;
+    int n = grafo_ordenacao->n;
+    int da = floresta.dist[ca * n + cidade_ordenacao];
+    int db = floresta.dist[cb * n + cidade_ordenacao];
+    if (da != db) return da < db ? -1 : 1;
+    return floresta.capitais[ca] - floresta.capitais[cb];
+}
+
+void constroi_floresta(Grafo *g) {
+    int n = g->n;
+    if (n > INT16_MAX) {
+        fprintf(stderr, "Grafo com %d cidades excede o vetor de pais de 16 bits\n", n);
+        exit(1);
+    }
+    floresta.n_capitais = 0;
+    floresta.capitais = malloc(n * sizeof(int));
     for (int i = 0; i < n; i++) {
-        Node *node = &g->nodes[i];
-        if (node->_tipo == 1 && node->_ocupada == 0) {
-            if (dist[i] < melhor_dist) {
-                melhor_dist = dist[i];
-                melhor_idx = i;
-            }
+        if (g->nodes[i]._tipo == 1) floresta.capitais[floresta.n_capitais++] = i;
+    }
+    int nc = floresta.n_capitais;
+    floresta.dist = malloc((size_t)nc * n * sizeof(int));
+    floresta.pai = malloc((size_t)nc * n * sizeof(int16_t));
+    floresta.ordem = malloc((size_t)n * (nc ? nc : 1) * sizeof(int));
+    for (int c = 0; c < nc; c++) {
+        dijkstra_distancias(g, floresta.capitais[c], &floresta.dist[c * n], &floresta.pai[c * n]);
+    }
+
+    grafo_ordenacao = g;
+    for (int v = 0; v < n; v++) {
+        int *ordem = &floresta.ordem[v * nc];
+        for (int c = 0; c < nc; c++) ordem[c] = c;
+        cidade_ordenacao = v;
+        qsort(ordem, nc, sizeof(int), compara_capitais);
+    }
+}
+
+/* k capitais alcançáveis mais próximas de id_cidade, sem efeitos colaterais; retorna quantas */
+int capitais_mais_proximas(Grafo *g, int id_cidade, int k, capital_proxima_t *out) {
+    if (id_cidade < 0 || id_cidade >= g->n) return 0;
+    int n = g->n;
+    int total = 0;
+    for (int j = 0; j < floresta.n_capitais && total < k; j++) {
+        int c = floresta.ordem[id_cidade * floresta.n_capitais + j];
+        int d = floresta.dist[c * n + id_cidade];
+        if (d == INT_MAX) break;
+        int id_capital = floresta.capitais[c];
+        out[total].id_capital = id_capital;
+        out[total].distancia = d;
+        out[total].livres = atomic_load(&g->nodes[id_capital]._livres);
+        out[total].frota = g->nodes[id_capital]._frota;
+        total++;
+    }
+    return total;
+}
+
+/* Escolhe a capital mais próxima com drone livre pela floresta e reserva um
+   drone; distância via out_dist e índice da capital na floresta via out_c */
+int escolhe_equipe(Grafo *g, int origem, int *out_dist, int *out_c) {
+    int n = g->n;
+    for (int j = 0; j < floresta.n_capitais; j++) {
+        int c = floresta.ordem[origem * floresta.n_capitais + j];
+        int d = floresta.dist[c * n + origem];
+        if (d == INT_MAX) break;
+        int id_capital = floresta.capitais[c];
+        if (reserva_unidade(&g->nodes[id_capital])) {
+            if (out_dist) *out_dist = d;
+            if (out_c) *out_c = c;
+            return g->nodes[id_capital]._idx;
         }
     }
+    if (out_dist) *out_dist = -1;
+    return -1;
+}
 
-    if (melhor_idx == -1 || melhor_dist == INT_MAX) {
-        if (out_dist) *out_dist = -1;
-        return -1;
+/* Cache LRU de rotas codificadas (ids em 16 bits) para os pares capital->cidade mais usados */
+typedef struct {
+    int capital; // -1 = entrada livre
+    int cidade;
+    uint64_t uso;
+    uint16_t total;
+    uint16_t cidades[ROTA_MAX];
+} rota_cache_t;
+
+rota_cache_t rota_cache[ROTA_CACHE_TAM];
+uint64_t rota_relogio = 0;
+
+void inicia_rota_cache(void) {
+    for (int i = 0; i < ROTA_CACHE_TAM; i++) rota_cache[i].capital = -1;
+}
+
+/* rota da capital c (índice na floresta) até id_cidade; NULL se não couber em ROTA_MAX */
+rota_cache_t *rota_capital(Grafo *g, int c, int id_cidade) {
+    int n = g->n;
+    int id_capital = floresta.capitais[c];
+    rota_cache_t *vitima = &rota_cache[0];
+    for (int i = 0; i < ROTA_CACHE_TAM; i++) {
+        rota_cache_t *e = &rota_cache[i];
+        if (e->capital == id_capital && e->cidade == id_cidade) {
+            e->uso = ++rota_relogio;
+            return e;
+        }
+        if (e->capital == -1 || (vitima->capital != -1 && e->uso < vitima->uso)) vitima = e;
     }
 
-    g->nodes[melhor_idx]._ocupada = 1;
-    if (out_dist) *out_dist = melhor_dist;
-    return g->nodes[melhor_idx]._idx;
+    // sobe pela árvore da capital a partir da cidade e grava invertido
+    uint16_t inversa[ROTA_MAX];
+    int total = 0;
+    for (int v = id_cidade; v != -1; v = floresta.pai[c * n + v]) {
+        if (total == ROTA_MAX) return NULL;
+        inversa[total++] = (uint16_t)v;
+    }
+    vitima->capital = id_capital;
+    vitima->cidade = id_cidade;
+    vitima->uso = ++rota_relogio;
+    vitima->total = (uint16_t)total;
+    for (int i = 0; i < total; i++) vitima->cidades[i] = inversa[total - 1 - i];
+    return vitima;
 }
 
 /* Envia ACK (payload.status em network order) */
@@ -199,42 +839,831 @@ void send_ack(int sockfd, struct sockaddr_storage *client_addr, socklen_t client
     memcpy(buffer, &h, sizeof(h));
     memcpy(buffer + sizeof(h), &ack, sizeof(ack));
 
-    sendto(sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *)client_addr, client_len);
+    envia_datagrama(sockfd, client_addr, client_len, buffer, sizeof(buffer));
 }
 
-/* Envia mensagem de equipe (os campos já devem estar em network order no payload) */
-ssize_t enviar_msg_equipe(int sockfd, struct sockaddr_storage *client_addr, socklen_t client_len, int id_cidade, int id_equipe) {
+/* Envia ACK de conclusão com a missão confirmada */
+void send_ack_conclusao(int sockfd, struct sockaddr_storage *client_addr, socklen_t client_len, int id_cidade, int id_equipe) {
+    header_t h;
+    payload_ack_conclusao_t ack;
+    h.tipo = htons(MSG_ACK);
+    h.tamanho = htons((uint16_t)sizeof(ack));
+    ack.status = htonl(2);
+    ack.id_cidade = htonl(id_cidade);
+    ack.id_equipe = htonl(id_equipe);
+
+    uint8_t buffer[sizeof(header_t) + sizeof(ack)];
+    memcpy(buffer, &h, sizeof(h));
+    memcpy(buffer + sizeof(h), &ack, sizeof(ack));
+    envia_datagrama(sockfd, client_addr, client_len, buffer, sizeof(buffer));
+}
+
+/* Envia mensagem de equipe seguida da rota capital -> cidade (rota pode ser NULL) */
+ssize_t enviar_msg_equipe(int sockfd, struct sockaddr_storage *client_addr, socklen_t client_len, int id_cidade, int id_equipe,
+                          rota_cache_t *rota) {
     header_t h;
     payload_equipe_drone_t p;
+    payload_rota_t r;
+    int total = rota ? rota->total : 0;
+    size_t tam_rota = sizeof(int) + total * sizeof(int);
     h.tipo = htons(MSG_EQUIPE_DRONE);
-    h.tamanho = htons((uint16_t)sizeof(payload_equipe_drone_t));
+    h.tamanho = htons((uint16_t)(sizeof(payload_equipe_drone_t) + tam_rota));
     p.id_cidade = htonl(id_cidade);
     p.id_equipe = htonl(id_equipe);
+    r.total = htonl(total);
+    for (int i = 0; i < total; i++) r.cidades[i] = htonl(rota->cidades[i]);
 
-    uint8_t buffer[sizeof(header_t) + sizeof(payload_equipe_drone_t)];
+    uint8_t buffer[sizeof(header_t) + sizeof(payload_equipe_drone_t) + sizeof(payload_rota_t)];
     memcpy(buffer, &h, sizeof(h));
     memcpy(buffer + sizeof(h), &p, sizeof(p));
-    return sendto(sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *)client_addr, client_len);
+    memcpy(buffer + sizeof(h) + sizeof(p), &r, tam_rota);
+    return envia_datagrama(sockfd, client_addr, client_len, buffer, sizeof(h) + sizeof(p) + tam_rota);
 }
 
-/* Variável para mostrar qual alerta foi o último enviado (heurística simples) */
-int last_sent_alert = -1;
+/*
+ Repasse entre regiões: sem drone livre, o shard calcula o custo da cidade até
+ cada aresta de fronteira (a, b) e manda o alerta, via roteador, para a região
+ de b mais barata. Quem recebe escolhe a capital livre que minimiza
+ custo + dist(capital, b); sem nenhuma, passa para a próxima região da lista.
+ */
+#define HANDOFF_MAX_ENTRADAS 8
+
+typedef struct {
+    int u, v, peso; // ids globais, em regiões diferentes
+} fronteira_t;
+
+fronteira_t *fronteiras = NULL;
+int n_fronteiras = 0;
+
+typedef struct {
+    int shard;        // região dona de no_fronteira
+    int no_fronteira; // b
+    int custo;        // dist(cidade, a) + peso(a, b)
+    int total;        // caminho a ... cidade (0 = não coube em ROTA_MAX)
+    int caminho[ROTA_MAX];
+} entrada_handoff_t;
+
+typedef struct {
+    int id_cidade;
+    int origem;
+    int tentados; // bitmask de shards que já tentaram
+    int n;
+    entrada_handoff_t entradas[HANDOFF_MAX_ENTRADAS];
+} handoff_t;
+
+int carrega_fronteiras(const char *arquivo) {
+    FILE *f = fopen(arquivo, "r");
+    if (!f) {
+        perror("Erro abrindo fronteiras");
+        return -1;
+    }
+    int cap = 16, u, v, p;
+    fronteiras = malloc(cap * sizeof(fronteira_t));
+    while (fscanf(f, "%d %d %d", &u, &v, &p) == 3) {
+        int du = dono_cidade(u), dv = dono_cidade(v);
+        if (du < 0 || dv < 0 || du == dv) {
+            fprintf(stderr, "Fronteira %d-%d ignorada: precisa ligar duas regiões\n", u, v);
+            continue;
+        }
+        if (n_fronteiras == cap) {
+            cap *= 2;
+            fronteiras = realloc(fronteiras, cap * sizeof(fronteira_t));
+        }
+        fronteiras[n_fronteiras++] = (fronteira_t){ u, v, p };
+    }
+    fclose(f);
+    return 0;
+}
+
+/* manda o repasse para a próxima região da lista que ainda não tentou */
+void repassa_handoff(Grafo *g, handoff_t *h, struct sockaddr_storage *client_addr, socklen_t client_len) {
+    for (int i = 0; i < h->n; i++) {
+        int destino = h->entradas[i].shard;
+        if (h->tentados & (1 << destino)) continue;
+        envelope_t env;
+        memset(&env, 0, sizeof(env));
+        env.tipo = ENV_HANDOFF;
+        env.destino = destino;
+        env.lote = lote_atual;
+        env.addr = *client_addr;
+        env.addr_len = client_len;
+        if (envia_envelope(ipc_fd, &env, h, sizeof(*h)) < 0) {
+            perror("repasse");
+            return;
+        }
+        printf("-> Alerta de %s (ID=%d) repassado à região %d\n\n", g->nodes[h->id_cidade]._nome, h->id_cidade, destino);
+        return;
+    }
+    printf("-> Nenhuma região vizinha com drone livre para %s (ID=%d)\n\n", g->nodes[h->id_cidade]._nome, h->id_cidade);
+}
+
+void inicia_handoff(Grafo *g, int id_cidade, struct sockaddr_storage *client_addr, socklen_t client_len) {
+    int n = g->n;
+    int dist[n];
+    int16_t pai[n];
+    dijkstra_distancias(g, id_cidade, dist, pai);
+
+    handoff_t h;
+    memset(&h, 0, sizeof(h));
+    h.id_cidade = id_cidade;
+    h.origem = shard_id;
+    h.tentados = 1 << shard_id;
+    for (int i = 0; i < n_fronteiras; i++) {
+        int a, b;
+        if (dono_cidade(fronteiras[i].u) == shard_id) {
+            a = fronteiras[i].u;
+            b = fronteiras[i].v;
+        } else if (dono_cidade(fronteiras[i].v) == shard_id) {
+            a = fronteiras[i].v;
+            b = fronteiras[i].u;
+        } else {
+            continue;
+        }
+        if (dist[a] == INT_MAX) continue;
+
+        // mantém as entradas ordenadas por custo
+        entrada_handoff_t e;
+        e.shard = dono_cidade(b);
+        e.no_fronteira = b;
+        e.custo = dist[a] + fronteiras[i].peso;
+        e.total = 0;
+        for (int v = a; v != -1 && e.total >= 0; v = pai[v]) {
+            if (e.total == ROTA_MAX) e.total = -1;
+            else e.caminho[e.total++] = v;
+        }
+        if (e.total < 0) e.total = 0;
+        int pos = h.n;
+        while (pos > 0 && h.entradas[pos - 1].custo > e.custo) pos--;
+        if (pos >= HANDOFF_MAX_ENTRADAS) continue;
+        int fim = h.n < HANDOFF_MAX_ENTRADAS ? h.n : HANDOFF_MAX_ENTRADAS - 1;
+        memmove(&h.entradas[pos + 1], &h.entradas[pos], (fim - pos) * sizeof(entrada_handoff_t));
+        h.entradas[pos] = e;
+        if (h.n < HANDOFF_MAX_ENTRADAS) h.n++;
+    }
+    repassa_handoff(g, &h, client_addr, client_len);
+}
+
+/* Alerta de outra região: despacha da capital local mais barata ou repassa adiante */
+void recebe_handoff(Grafo *g, int sockfd, handoff_t *h, struct sockaddr_storage *client_addr, socklen_t client_len) {
+    int n = g->n;
+    int nc = floresta.n_capitais;
+    int id = h->id_cidade;
+    if (id < 0 || id >= n || h->n < 0 || h->n > HANDOFF_MAX_ENTRADAS) return;
+
+    printf("[REPASSE RECEBIDO]\n");
+    printf("Cidade em alerta: %s (ID=%d), vinda da região %d\n", g->nodes[id]._nome, id, h->origem);
+
+    int melhor_total = INT_MAX, melhor_c = -1, melhor_e = -1;
+    for (int i = 0; i < h->n; i++) {
+        entrada_handoff_t *e = &h->entradas[i];
+        int b = e->no_fronteira;
+        if (e->shard != shard_id || b < 0 || b >= n) continue;
+        // a primeira capital com drone livre na ordem de b é a melhor por esta fronteira
+        for (int j = 0; j < nc; j++) {
+            int c = floresta.ordem[b * nc + j];
+            int d = floresta.dist[c * n + b];
+            if (d == INT_MAX) break;
+            if (atomic_load(&g->nodes[floresta.capitais[c]]._livres) == 0) continue;
+            if (e->custo + d < melhor_total) {
+                melhor_total = e->custo + d;
+                melhor_c = c;
+                melhor_e = i;
+            }
+            break;
+        }
+    }
+
+    int id_equipe = melhor_c >= 0 ? floresta.capitais[melhor_c] : -1;
+    if (id_equipe == -1 || !reserva_unidade(&g->nodes[id_equipe])) {
+        printf("-> Nenhuma capital com drone livre nesta região\n");
+        h->tentados |= 1 << shard_id;
+        repassa_handoff(g, h, client_addr, client_len);
+        return;
+    }
+
+    time_t agora = time(NULL);
+    int idx_alert = registrar_alerta(id, agora);
+    journal_registra(JR_ALERTA, id, -1, 0, agora);
+    if (idx_alert < 0) {
+        devolve_unidade(&g->nodes[id_equipe]);
+        printf("-> Todos os %d alertas registrados têm equipe atuando; repasse descartado\n\n", total_alertas);
+        return;
+    }
+
+    // rota: capital ... b pela árvore local, depois a ... cidade vindo da origem
+    entrada_handoff_t *e = &h->entradas[melhor_e];
+    rota_cache_t rota;
+    uint16_t inversa[ROTA_MAX];
+    int parte = 0;
+    for (int v = e->no_fronteira; v != -1 && parte <= ROTA_MAX; v = floresta.pai[melhor_c * n + v]) {
+        if (parte < ROTA_MAX) inversa[parte] = (uint16_t)v;
+        parte++;
+    }
+    rota.total = 0;
+    if (e->total > 0 && parte + e->total <= ROTA_MAX) {
+        for (int i = 0; i < parte; i++) rota.cidades[rota.total++] = inversa[parte - 1 - i];
+        for (int i = 0; i < e->total; i++) rota.cidades[rota.total++] = (uint16_t)e->caminho[i];
+    }
+
+    printf("-> Capital %s (ID=%d) selecionada, distância=%d km, drones livres=%d/%d\n",
+           g->nodes[id_equipe]._nome, id_equipe, melhor_total,
+           atomic_load(&g->nodes[id_equipe]._livres), g->nodes[id_equipe]._frota);
+    if (rota.total > 0) {
+        printf("-> Rota:");
+        for (int k = 0; k < rota.total; k++) printf("%s %s", k ? " ->" : "", g->nodes[rota.cidades[k]]._nome);
+        printf("\n");
+    }
+
+    // o despacho vai para o journal antes de a ordem entrar na fila de saída
+    aplica_despacho(id_equipe, idx_alert);
+    journal_registra(JR_DESPACHO, id, id_equipe, idx_alert, time(NULL));
+    if (enviar_msg_equipe(sockfd, client_addr, client_len, id, id_equipe, rota.total > 0 ? &rota : NULL) < 0) {
+        perror("sendto MSG_EQUIPE_DRONE failed");
+        aplica_conclusao(g, id, id_equipe);
+        journal_registra(JR_CONCLUSAO, id, id_equipe, 0, time(NULL));
+        return;
+    }
+    printf("-> Ordem enviada : Equipe %s (ID=%d) -> Cidade %s (ID=%d)\n\n",
+           g->nodes[id_equipe]._nome, id_equipe, g->nodes[id]._nome, id);
+}
+
+/* Atualiza o status das cidades e despacha equipes para as que entraram em alerta */
+void processa_status(Grafo *g, int sockfd, struct sockaddr_storage *client_addr, socklen_t client_len,
+                     telemetria_t *dados, int total) {
+    // Para cada nova cidade que passou de 0->1, registrar e despachar
+    for (int i = 0; i < total; i++) {
+        int id = dados[i].id_cidade;
+        int st = dados[i].status;
+        if (id < 0 || id >= g->n) continue;
+        if (g->nodes[id]._status != st) journal_registra(JR_STATUS, id, -1, st, time(NULL));
+        if (g->nodes[id]._status == 0 && st == 1) {
+            time_t agora = time(NULL);
+            int idx_alert = registrar_alerta(id, agora);
+            journal_registra(JR_ALERTA, id, -1, 0, agora);
+            int distancia = -1;
+            int c = -1;
+            int id_equipe = idx_alert < 0 ? -1 : escolhe_equipe(g, id, &distancia, &c);
+            printf("[DESPACHANDO DRONES]\n");
+            printf("Cidade em alerta: %s (ID=%d)\n", g->nodes[id]._nome, id);
+
+            if (idx_alert < 0) {
+                printf("-> Todos os %d alertas registrados têm equipe atuando; alerta descartado\n\n", total_alertas);
+            } else if (id_equipe == -1) {
+                printf("-> Nenhuma equipe disponível alcançável para cidade %s (ID=%d)\n", g->nodes[id]._nome, id);
+                if (ipc_fd >= 0 && n_fronteiras > 0) {
+                    inicia_handoff(g, id, client_addr, client_len);
+                } else {
+                    printf("\n");
+                }
+            } else {
+                // log dijkstra
+                printf("-> Dijkstra: capital %s (ID=%d) selecionada, distância=%d km, drones livres=%d/%d\n",
+                       g->nodes[id_equipe]._nome, id_equipe, distancia >= 0 ? distancia : 0,
+                       atomic_load(&g->nodes[id_equipe]._livres), g->nodes[id_equipe]._frota);
+
+                // envia ordem ao cliente (usa client_addr do recv)
+                rota_cache_t *rota = rota_capital(g, c, id);
+                if (rota) {
+                    printf("-> Rota:");
+                    for (int k = 0; k < rota->total; k++) {
+                        printf("%s %s", k ? " ->" : "", g->nodes[rota->cidades[k]]._nome);
+                    }
+                    printf("\n");
+                }
+
+                // registra qual equipe está atuando nesse alerta (no journal antes da ordem sair)
+                aplica_despacho(id_equipe, idx_alert);
+                journal_registra(JR_DESPACHO, id, id_equipe, idx_alert, time(NULL));
+
+                ssize_t sent = enviar_msg_equipe(sockfd, client_addr, client_len, id, id_equipe, rota);
+                if (sent < 0) {
+                    // a ordem não saiu: desfaz o despacho e o drone volta para a capital
+                    perror("sendto MSG_EQUIPE_DRONE failed");
+                    aplica_conclusao(g, id, id_equipe);
+                    journal_registra(JR_CONCLUSAO, id, id_equipe, 0, time(NULL));
+                } else {
+                    printf("-> Ordem enviada : Equipe %s (ID=%d) -> Cidade %s (ID=%d)\n\n",
+                           g->nodes[id_equipe]._nome, id_equipe, g->nodes[id]._nome, id);
+                }
+            }
+            // marca status interno
+            g->nodes[id]._status = st;
+        } else {
+            // só atualiza status
+            g->nodes[id]._status = st;
+        }
+    }
+}
+
+/* Trata um datagrama de cliente (recebido direto ou repassado pelo roteador) */
+void processa_datagrama(Grafo *g, int sockfd, uint8_t *buf, ssize_t n, struct sockaddr_storage *addr, socklen_t client_len) {
+    struct sockaddr_storage client_addr = *addr;
+    header_t h;
+    memcpy(&h, buf, sizeof(h));
+    uint16_t tipo = ntohs(h.tipo);
+    uint16_t tamanho = ntohs(h.tamanho);
+    uint8_t *payload = buf + sizeof(header_t);
+
+    if (tipo == MSG_TELEMETRIA) {
+        payload_telemetria_t tele;
+        memcpy(&tele, payload, sizeof(payload_telemetria_t));
+        // conversão de endianness
+        tele.total = ntohl(tele.total);
+        for (int i = 0; i < tele.total && i < 50; i++) {
+            tele.dados[i].id_cidade = ntohl(tele.dados[i].id_cidade);
+            tele.dados[i].status = ntohl(tele.dados[i].status);
+        }
+
+        printf("[TELEMETRIA RECEBIDA]\n");
+        printf("Total de cidades monitoradas: %d\n", tele.total);
+
+        // imprime alertas
+        int any_alert = 0;
+        for (int i = 0; i < tele.total && i < 50; i++) {
+            if (tele.dados[i].status == 1) {
+                any_alert = 1;
+                int id = tele.dados[i].id_cidade;
+                printf("ALERTA: %s (ID=%d)\n", g->nodes[id]._nome, id);
+            }
+        }
+        if (!any_alert) {
+            printf("Nenhum alerta na telemetria.\n");
+        }
+
+        processa_status(g, sockfd, &client_addr, client_len, tele.dados, tele.total < 50 ? tele.total : 50);
+
+        // envia ACK telemetria (status 0), depois dos registros do que ele confirma
+        if (!lote_atual) {
+            send_ack(sockfd, &client_addr, client_len, 0);
+            printf("-> ACK enviado (tipo=0)\n\n");
+        }
+
+    } else if (tipo == MSG_ALERTA) {
+        // payload de tamanho variável: total + só as cidades que mudaram
+        payload_telemetria_t al;
+        size_t max_bytes = (size_t)(n - (ssize_t)sizeof(header_t));
+        if (tamanho < max_bytes) max_bytes = tamanho;
+        if (max_bytes < sizeof(int)) return;
+        if (max_bytes > sizeof(al)) max_bytes = sizeof(al);
+        memcpy(&al, payload, max_bytes);
+        int total = ntohl(al.total);
+        int cabem = (int)((max_bytes - sizeof(int)) / sizeof(telemetria_t));
+        if (total > cabem) total = cabem;
+        if (total < 0) total = 0;
+        for (int i = 0; i < total; i++) {
+            al.dados[i].id_cidade = ntohl(al.dados[i].id_cidade);
+            al.dados[i].status = ntohl(al.dados[i].status);
+        }
+
+        printf("[ALERTA RECEBIDO]\n");
+        for (int i = 0; i < total; i++) {
+            int id = al.dados[i].id_cidade;
+            if (id < 0 || id >= g->n) continue;
+            printf("%s: %s (ID=%d)\n", al.dados[i].status == 1 ? "ALERTA" : "NORMAL", g->nodes[id]._nome, id);
+        }
+
+        processa_status(g, sockfd, &client_addr, client_len, al.dados, total);
+
+        // envia ACK alerta (status 3), depois dos registros do que ele confirma
+        if (!lote_atual) {
+            send_ack(sockfd, &client_addr, client_len, 3);
+            printf("-> ACK enviado (tipo=3)\n\n");
+        }
+
+    } else if (tipo == MSG_CONSULTA) {
+        if (tamanho >= 2 * sizeof(int)) {
+            payload_consulta_t q;
+            memset(&q, 0, sizeof(q));
+            size_t bytes = (size_t)(n - (ssize_t)sizeof(header_t));
+            if (bytes > sizeof(q)) bytes = sizeof(q);
+            memcpy(&q, payload, bytes);
+            int k = ntohl(q.k);
+            int total = ntohl(q.total);
+            if (k < 1) k = 1;
+            if (k > CONSULTA_MAX_K) k = CONSULTA_MAX_K;
+            int cabem = (int)((bytes - 2 * sizeof(int)) / sizeof(int));
+            if (total > cabem) total = cabem;
+            if (total < 0) total = 0;
+
+            printf("[CONSULTA RECEBIDA] k=%d, %d cidade(s)\n\n", k, total);
+
+            payload_resposta_consulta_t resp;
+            memset(&resp, 0, sizeof(resp));
+            resp.total = htonl(total);
+            for (int i = 0; i < total; i++) {
+                int id = ntohl(q.cidades[i]);
+                resposta_cidade_t *rc = &resp.cidades[i];
+                capital_proxima_t caps[CONSULTA_MAX_K];
+                int achadas = capitais_mais_proximas(g, id, k, caps);
+                rc->id_cidade = htonl(id);
+                rc->total = htonl(achadas);
+                for (int j = 0; j < achadas; j++) {
+                    rc->capitais[j].id_capital = htonl(caps[j].id_capital);
+                    rc->capitais[j].distancia = htonl(caps[j].distancia);
+                    rc->capitais[j].livres = htonl(caps[j].livres);
+                    rc->capitais[j].frota = htonl(caps[j].frota);
+                }
+            }
+
+            header_t rh;
+            uint16_t rtam = (uint16_t)(sizeof(int) + total * sizeof(resposta_cidade_t));
+            rh.tipo = htons(MSG_RESPOSTA_CONSULTA);
+            rh.tamanho = htons(rtam);
+            uint8_t rbuf[sizeof(header_t) + sizeof(payload_resposta_consulta_t)];
+            memcpy(rbuf, &rh, sizeof(rh));
+            memcpy(rbuf + sizeof(rh), &resp, rtam);
+            envia_datagrama(sockfd, &client_addr, client_len, rbuf, sizeof(rh) + rtam);
+        }
+    } else if (tipo == MSG_ACK) {
+        if (tamanho >= sizeof(payload_ack_t)) {
+            payload_ack_t ap;
+            memcpy(&ap, payload, sizeof(ap));
+            int status = ntohl(ap.status);
+            if (status == 1) {
+                // ACK de ordem de drone
+                printf("[ACK RECEBIDO]\n");
+                // heurística: assume ACK corresponde ao último enviado
+                journal_registra(JR_ACK, -1, -1, last_sent_alert, time(NULL));
+                if (last_sent_alert >= 0 && last_sent_alert < total_alertas) {
+                    int id_c = alertas[last_sent_alert].id_cidade;
+                    printf("Cliente confirmou recebimento de ordem de drone para %s (ID=%d)\n\n",
+                           g->nodes[id_c]._nome, id_c);
+                } else {
+                    printf("Cliente confirmou recebimento de ordem de drone (sem mapeamento)\n\n");
+                }
+            } else if (status == 0) {
+                // ACK telemetria (geralmente já tratado no cliente)
+                // podemos logar se quiser
+            } else if (status == 2) {
+                // ACK de conclusao (servidor normalmente envia ACK, mas cliente pode enviar)
+                printf("[ACK RECEBIDO] status=2 (conclusão)\n\n");
+            }
+        }
+    } else if (tipo == MSG_CONCLUSAO) {
+        if (tamanho >= sizeof(payload_equipe_drone_t)) {
+            payload_equipe_drone_t p;
+            memcpy(&p, payload, sizeof(p));
+            int id_cidade = ntohl(p.id_cidade);
+            int id_equipe = ntohl(p.id_equipe);
+
+            if (id_cidade < 0 || id_cidade >= g->n || id_equipe < 0 || id_equipe >= g->n) return;
+
+            printf("[MISSAO CONCLUÍDA]\n");
+            printf("Cidade atendida: %s (ID=%d)\n", g->nodes[id_cidade]._nome, id_cidade);
+            printf("Equipe : %s (ID=%d)\n", g->nodes[id_equipe]._nome, id_equipe);
+
+            if (aplica_conclusao(g, id_cidade, id_equipe)) {
+                journal_registra(JR_CONCLUSAO, id_cidade, id_equipe, 0, time(NULL));
+                printf("-> Drone devolvido a %s (%d/%d livres)\n", g->nodes[id_equipe]._nome,
+                       atomic_load(&g->nodes[id_equipe]._livres), g->nodes[id_equipe]._frota);
+            } else {
+                printf("-> Nenhuma missão ativa correspondente (conclusão repetida), nada a liberar\n");
+            }
+            // envia ACK tipo=2 (também para repetições, senão o cliente retransmite)
+            send_ack_conclusao(sockfd, &client_addr, client_len, id_cidade, id_equipe);
+            printf("-> ACK enviado (tipo=2)\n\n");
+        }
+    } else {
+        // outros tipos
+    }
+}
+
+/* Grafo do shard propria: ids globais de todas as regiões, arestas só da própria */
+Grafo *cria_grafo_shard(int propria) {
+    int total = 0;
+    for (int i = 0; i < n_regioes; i++) total += regioes[i].n;
+    Grafo *g = aloca_grafo(total);
+    for (int i = 0; i < n_regioes; i++) {
+        FILE *f = fopen(regioes[i].arquivo, "r");
+        if (!f) {
+            perror("Erro abrindo região");
+            exit(1);
+        }
+        int N, M;
+        fscanf(f, "%d %d", &N, &M);
+        fgetc(f);
+        le_cidades_arestas(g, f, N, M, regioes[i].offset, i == propria);
+        fclose(f);
+    }
+    return g;
+}
+
+void executa_shard(int id, const char *prefixo_journal) {
+    shard_id = id;
+    for (int i = 0; i < n_regioes; i++) {
+        if (i != id) close(regioes[i].ipc);
+        close(regioes[i].fd);
+    }
+    ipc_fd = regioes[id].ipc;
+
+    Grafo *g = cria_grafo_shard(id);
+    constroi_floresta(g);
+    inicia_rota_cache();
+    printf("Região %d (%s): cidades %d..%d, %d capital(is)\n\n", id, regioes[id].arquivo,
+           regioes[id].offset, regioes[id].offset + regioes[id].n - 1, floresta.n_capitais);
+
+    if (prefixo_journal) {
+        char prefixo[300];
+        snprintf(prefixo, sizeof(prefixo), "%s.regiao%d", prefixo_journal, id);
+        if (journal_abre(g, prefixo) < 0) exit(1);
+    }
+
+    while (1) {
+        uint8_t buf[sizeof(envelope_t) + 8192];
+        // mesmo esquema do processo único: commit quando a fila do roteador esvazia
+        ssize_t n = recv(ipc_fd, buf, sizeof(buf), journal.fd >= 0 ? MSG_DONTWAIT : 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            journal_commit();
+            if (journal.desde_snapshot >= JOURNAL_SNAPSHOT) journal_snapshot(g);
+            n = recv(ipc_fd, buf, sizeof(buf), 0);
+        }
+        if (n == 0) break; // roteador saiu
+        if (n < (ssize_t)sizeof(envelope_t)) continue;
+
+        envelope_t env;
+        memcpy(&env, buf, sizeof(env));
+        uint8_t *dados = buf + sizeof(env);
+        ssize_t len = n - (ssize_t)sizeof(env);
+        lote_atual = env.lote;
+        if (env.tipo == ENV_DATAGRAMA && len >= (ssize_t)sizeof(header_t)) {
+            processa_datagrama(g, -1, dados, len, &env.addr, env.addr_len);
+        } else if (env.tipo == ENV_HANDOFF && len >= (ssize_t)sizeof(handoff_t)) {
+            handoff_t h;
+            memcpy(&h, dados, sizeof(h));
+            recebe_handoff(g, -1, &h, &env.addr, env.addr_len);
+        }
+        // o repasse gerado aqui (se houver) já saiu: a confirmação chega depois dele ao roteador
+        if (env.lote) agenda_confirmacao(env.lote);
+        lote_atual = 0;
+    }
+    journal_commit();
+    exit(0);
+}
+
+int ultimo_shard_ordem = 0; // quem recebe o ACK de ordem (o cliente não diz de qual região)
+
+/* datagramas divididos aguardando o commit de todas as partes; o lote indexa o
+   anel e um lote antigo sobrescrito só faz o cliente retransmitir */
+#define LOTES_PENDENTES 256
+
+typedef struct {
+    uint32_t lote; // 0 = vaga livre
+    int faltam;
+    int status;    // ACK a enviar: 0 telemetria, 3 alerta
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+} lote_pendente_t;
+
+lote_pendente_t lotes[LOTES_PENDENTES];
+uint32_t proximo_lote = 0;
+
+void lote_confirmado(int sockfd, uint32_t lote) {
+    lote_pendente_t *p = &lotes[lote % LOTES_PENDENTES];
+    if (p->lote != lote || --p->faltam > 0) return;
+    p->lote = 0;
+    send_ack(sockfd, &p->addr, p->addr_len, p->status);
+}
+
+void repassa_ao_shard(int destino, uint32_t lote, uint8_t *buf, size_t len, struct sockaddr_storage *addr, socklen_t addr_len) {
+    envelope_t env;
+    memset(&env, 0, sizeof(env));
+    env.tipo = ENV_DATAGRAMA;
+    env.lote = lote;
+    env.addr = *addr;
+    env.addr_len = addr_len;
+    if (envia_envelope(regioes[destino].fd, &env, buf, len) < 0) perror("envelope para região");
+}
+
+/* Divide o datagrama do cliente entre as regiões donas das cidades citadas */
+void roteia_datagrama(uint8_t *buf, ssize_t n, struct sockaddr_storage *addr, socklen_t addr_len) {
+    header_t h;
+    memcpy(&h, buf, sizeof(h));
+    uint16_t tipo = ntohs(h.tipo);
+    uint16_t tamanho = ntohs(h.tamanho);
+    uint8_t *payload = buf + sizeof(header_t);
+    size_t bytes = (size_t)(n - (ssize_t)sizeof(header_t));
+    if (tamanho < bytes) bytes = tamanho;
+
+    if (tipo == MSG_TELEMETRIA || tipo == MSG_ALERTA) {
+        payload_telemetria_t entrada;
+        memset(&entrada, 0, sizeof(entrada));
+        if (bytes > sizeof(entrada)) bytes = sizeof(entrada);
+        if (bytes < sizeof(int)) return;
+        memcpy(&entrada, payload, bytes);
+        int total = ntohl(entrada.total);
+        int cabem = (int)((bytes - sizeof(int)) / sizeof(telemetria_t));
+        if (total > cabem) total = cabem;
+        if (total < 0) total = 0;
+
+        // um ACK por datagrama, enviado aqui quando todas as partes forem confirmadas
+        int por_regiao[SHARDS_MAX] = { 0 };
+        int partes = 0;
+        for (int i = 0; i < total; i++) {
+            int dono = dono_cidade(ntohl(entrada.dados[i].id_cidade));
+            if (dono >= 0 && por_regiao[dono]++ == 0) partes++;
+        }
+        if (partes == 0) {
+            por_regiao[0] = -1; // sem cidades válidas: a região 0 processa (e confirma) o vazio
+            partes = 1;
+        }
+        if (++proximo_lote == 0) proximo_lote = 1;
+        lote_pendente_t *p = &lotes[proximo_lote % LOTES_PENDENTES];
+        p->lote = proximo_lote;
+        p->faltam = partes;
+        p->status = tipo == MSG_TELEMETRIA ? 0 : 3;
+        p->addr = *addr;
+        p->addr_len = addr_len;
+
+        for (int r = 0; r < n_regioes; r++) {
+            if (por_regiao[r] == 0) continue;
+            payload_telemetria_t parte;
+            memset(&parte, 0, sizeof(parte));
+            int k = 0;
+            for (int i = 0; i < total; i++) {
+                if (dono_cidade(ntohl(entrada.dados[i].id_cidade)) == r) parte.dados[k++] = entrada.dados[i];
+            }
+            parte.total = htonl(k);
+            // telemetria mantém o payload cheio; alerta vai só com as cidades da região
+            uint16_t tam = tipo == MSG_TELEMETRIA ? sizeof(parte) : (uint16_t)(sizeof(int) + k * sizeof(telemetria_t));
+            uint8_t saida[sizeof(header_t) + sizeof(payload_telemetria_t)];
+            header_t sh = { htons(tipo), htons(tam) };
+            memcpy(saida, &sh, sizeof(sh));
+            memcpy(saida + sizeof(sh), &parte, tam);
+            repassa_ao_shard(r, proximo_lote, saida, sizeof(sh) + tam, addr, addr_len);
+        }
+    } else if (tipo == MSG_CONSULTA) {
+        payload_consulta_t q;
+        memset(&q, 0, sizeof(q));
+        if (bytes > sizeof(q)) bytes = sizeof(q);
+        if (bytes < 2 * sizeof(int)) return;
+        memcpy(&q, payload, bytes);
+        int total = ntohl(q.total);
+        int cabem = (int)((bytes - 2 * sizeof(int)) / sizeof(int));
+        if (total > cabem) total = cabem;
+        if (total < 0) total = 0;
+
+        // cada região responde as suas cidades; o cliente junta as respostas
+        for (int r = 0; r < n_regioes; r++) {
+            payload_consulta_t parte;
+            parte.k = q.k;
+            int k = 0;
+            for (int i = 0; i < total; i++) {
+                int dono = dono_cidade(ntohl(q.cidades[i]));
+                if (dono == r || (dono < 0 && r == 0)) parte.cidades[k++] = q.cidades[i];
+            }
+            if (k == 0) continue;
+            parte.total = htonl(k);
+            uint16_t tam = (uint16_t)(2 * sizeof(int) + k * sizeof(int));
+            uint8_t saida[sizeof(header_t) + sizeof(payload_consulta_t)];
+            header_t sh = { htons(tipo), htons(tam) };
+            memcpy(saida, &sh, sizeof(sh));
+            memcpy(saida + sizeof(sh), &parte, tam);
+            repassa_ao_shard(r, 0, saida, sizeof(sh) + tam, addr, addr_len);
+        }
+    } else if (tipo == MSG_CONCLUSAO) {
+        // a conclusão devolve o drone: vai para a região da capital
+        if (bytes < sizeof(payload_equipe_drone_t)) return;
+        payload_equipe_drone_t p;
+        memcpy(&p, payload, sizeof(p));
+        int dono = dono_cidade(ntohl(p.id_equipe));
+        repassa_ao_shard(dono < 0 ? 0 : dono, 0, buf, (size_t)n, addr, addr_len);
+    } else if (tipo == MSG_ACK) {
+        repassa_ao_shard(ultimo_shard_ordem, 0, buf, (size_t)n, addr, addr_len);
+    }
+}
+
+/* Processo principal com regiões: todo o I/O UDP passa por aqui */
+void executa_roteador(int sockfd) {
+    struct pollfd pfd[SHARDS_MAX + 1];
+    pfd[0].fd = sockfd;
+    pfd[0].events = POLLIN;
+    for (int i = 0; i < n_regioes; i++) {
+        pfd[i + 1].fd = regioes[i].fd;
+        pfd[i + 1].events = POLLIN;
+    }
+
+    while (1) {
+        int prontos = poll(pfd, n_regioes + 1, 0);
+        if (prontos == 0) {
+            if (trace) fflush(trace);
+            prontos = poll(pfd, n_regioes + 1, -1);
+        }
+        if (prontos < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        if (pfd[0].revents & POLLIN) {
+            uint8_t buf[4096];
+            struct sockaddr_storage client_addr;
+            socklen_t client_len = sizeof(client_addr);
+            ssize_t n = recvfrom(sockfd, buf, sizeof(buf), 0, (struct sockaddr *)&client_addr, &client_len);
+            if (n > 0) captura_registra(0, &client_addr, buf, (size_t)n);
+            if (n >= (ssize_t)sizeof(header_t)) roteia_datagrama(buf, n, &client_addr, client_len);
+        }
+
+        for (int i = 0; i < n_regioes; i++) {
+            if (pfd[i + 1].revents & (POLLHUP | POLLERR)) {
+                fprintf(stderr, "Região %d encerrou\n", i);
+                return;
+            }
+            if (!(pfd[i + 1].revents & POLLIN)) continue;
+            uint8_t buf[sizeof(envelope_t) + 8192];
+            ssize_t n = recv(regioes[i].fd, buf, sizeof(buf), 0);
+            if (n < (ssize_t)sizeof(envelope_t)) continue;
+            envelope_t env;
+            memcpy(&env, buf, sizeof(env));
+            uint8_t *dados = buf + sizeof(env);
+            size_t len = (size_t)(n - (ssize_t)sizeof(env));
+
+            if (env.tipo == ENV_DATAGRAMA && len >= sizeof(header_t)) {
+                header_t h;
+                memcpy(&h, dados, sizeof(h));
+                if (ntohs(h.tipo) == MSG_EQUIPE_DRONE) ultimo_shard_ordem = i;
+                if (sendto(sockfd, dados, len, 0, (struct sockaddr *)&env.addr, env.addr_len) >= 0) {
+                    captura_registra(1, &env.addr, dados, len);
+                }
+            } else if (env.tipo == ENV_CONFIRMA) {
+                lote_confirmado(sockfd, env.lote);
+            } else if (env.tipo == ENV_HANDOFF && env.destino >= 0 && env.destino < n_regioes) {
+                lote_pendente_t *p = &lotes[env.lote % LOTES_PENDENTES];
+                if (send(regioes[env.destino].fd, buf, (size_t)n, 0) < 0) {
+                    perror("repasse entre regiões");
+                } else if (env.lote && p->lote == env.lote) {
+                    p->faltam++; // o destino também confirma o lote
+                }
+            }
+        }
+    }
+}
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Uso: %s v4|v6\n", argv[0]);
+    const char *uso = "Uso: %s v4|v6 [-j prefixo_journal] [-c arquivo_trace] [-r regiao.txt ... [-f fronteiras.txt]]\n";
+    if (argc < 2) {
+        fprintf(stderr, uso, argv[0]);
         return 1;
     }
+    const char *prefixo_journal = NULL;
+    const char *arquivo_trace = NULL;
+    const char *arquivo_fronteiras = NULL;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            prefixo_journal = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            arquivo_trace = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc && n_regioes < SHARDS_MAX) {
+            snprintf(regioes[n_regioes++].arquivo, sizeof(regioes[0].arquivo), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            arquivo_fronteiras = argv[++i];
+        } else {
+            fprintf(stderr, uso, argv[0]);
+            return 1;
+        }
+    }
 
-    FILE *f = fopen("grafo_amazonia_legal.txt", "r");
     int porta = 8080;
-    if (!f) {
-        perror("Erro abrindo arquivo");
-        return 1;
-    }
+    Grafo *g = NULL;
 
-    Grafo *g = cria_grafo(f);
-    fclose(f);
+    if (n_regioes == 0) {
+        FILE *f = fopen("grafo_amazonia_legal.txt", "r");
+        if (!f) {
+            perror("Erro abrindo arquivo");
+            return 1;
+        }
+
+        g = cria_grafo(f);
+        fclose(f);
+
+        constroi_floresta(g);
+        inicia_rota_cache();
+
+        if (prefixo_journal && journal_abre(g, prefixo_journal) < 0) return 1;
+    } else {
+        // só os cabeçalhos aqui: cada shard carrega o próprio grafo depois do fork
+        int offset = 0;
+        for (int i = 0; i < n_regioes; i++) {
+            FILE *f = fopen(regioes[i].arquivo, "r");
+            int N, M;
+            if (!f || fscanf(f, "%d %d", &N, &M) != 2) {
+                fprintf(stderr, "Erro lendo região %s\n", regioes[i].arquivo);
+                return 1;
+            }
+            fclose(f);
+            regioes[i].offset = offset;
+            regioes[i].n = N;
+            offset += N;
+
+            int par[2];
+            if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, par) < 0) {
+                perror("socketpair");
+                return 1;
+            }
+            regioes[i].fd = par[0];
+            regioes[i].ipc = par[1];
+        }
+        if (arquivo_fronteiras && carrega_fronteiras(arquivo_fronteiras) < 0) return 1;
+    }
 
     printf("Servidor escutando na porta %d...\n\n", porta);
 
@@ -259,147 +1688,54 @@ int main(int argc, char *argv[]) {
         bind(sockfd, (struct sockaddr *)&addr6, sizeof(addr6));
     }
 
-    while (1) {
-        uint8_t buf[4096];
-        struct sockaddr_storage client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        ssize_t n = recvfrom(sockfd, buf, sizeof(buf), 0, (struct sockaddr *)&client_addr, &client_len);
-        if (n < (ssize_t)sizeof(header_t)) continue;
-
-        header_t h;
-        memcpy(&h, buf, sizeof(h));
-        uint16_t tipo = ntohs(h.tipo);
-        uint16_t tamanho = ntohs(h.tamanho);
-        uint8_t *payload = buf + sizeof(header_t);
-
-        if (tipo == MSG_TELEMETRIA) {
-            payload_telemetria_t tele;
-            memcpy(&tele, payload, sizeof(payload_telemetria_t));
-            // conversão de endianness
-            tele.total = ntohl(tele.total);
-            for (int i = 0; i < tele.total && i < 50; i++) {
-                tele.dados[i].id_cidade = ntohl(tele.dados[i].id_cidade);
-                tele.dados[i].status = ntohl(tele.dados[i].status);
+    if (n_regioes > 0) {
+        fflush(stdout);
+        for (int i = 0; i < n_regioes; i++) {
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                return 1;
             }
-
-            printf("[TELEMETRIA RECEBIDA]\n");
-            printf("Total de cidades monitoradas: %d\n", tele.total);
-
-            // imprime alertas
-            int any_alert = 0;
-            for (int i = 0; i < tele.total && i < 50; i++) {
-                if (tele.dados[i].status == 1) {
-                    any_alert = 1;
-                    int id = tele.dados[i].id_cidade;
-                    printf("ALERTA: %s (ID=%d)\n", g->nodes[id]._nome, id);
-                }
+            if (pid == 0) {
+                close(sockfd);
+                executa_shard(i, prefixo_journal);
             }
-            if (!any_alert) {
-                printf("Nenhum alerta na telemetria.\n");
-            }
-
-            // envia ACK telemetria (status 0)
-            send_ack(sockfd, &client_addr, client_len, 0);
-            printf("-> ACK enviado (tipo=0)\n\n");
-
-            // Para cada nova cidade que passou de 0->1, registrar e despachar
-            for (int i = 0; i < tele.total && i < 50; i++) {
-                int id = tele.dados[i].id_cidade;
-                int st = tele.dados[i].status;
-                if (g->nodes[id]._status == 0 && st == 1) {
-                    registrar_alerta(id);
-                    int distancia = -1;
-                    int id_equipe = dijkstra_escolhe_equipe(g, id, &distancia);
-                    printf("[DESPACHANDO DRONES]\n");
-                    printf("Cidade em alerta: %s (ID=%d)\n", g->nodes[id]._nome, id);
-
-                    if (id_equipe == -1) {
-                        printf("-> Nenhuma equipe disponível alcançável para cidade %s (ID=%d)\n\n", g->nodes[id]._nome, id);
-                    } else {
-                        // log dijkstra
-                        printf("-> Dijkstra: capital %s (ID=%d) selecionada, distância=%d km\n",
-                               g->nodes[id_equipe]._nome, id_equipe, distancia >= 0 ? distancia : 0);
-
-                        // envia ordem ao cliente (usa client_addr do recv)
-                        ssize_t sent = enviar_msg_equipe(sockfd, &client_addr, client_len, id, id_equipe);
-                        if (sent < 0) {
-                            perror("sendto MSG_EQUIPE_DRONE failed");
-                        } else {
-                            // registra qual equipe está atuando nesse alerta (heurística: último alerta)
-                            int idx_alert = total_alertas - 1;
-                            if (idx_alert >= 0) alertas[idx_alert].equipe_atuando = id_equipe;
-                            last_sent_alert = idx_alert;
-
-                            printf("-> Ordem enviada : Equipe %s (ID=%d) -> Cidade %s (ID=%d)\n\n",
-                                   g->nodes[id_equipe]._nome, id_equipe, g->nodes[id]._nome, id);
-                        }
-                    }
-                    // marca status interno
-                    g->nodes[id]._status = st;
-                } else {
-                    // só atualiza status
-                    g->nodes[id]._status = st;
-                }
-            }
-
-        } else if (tipo == MSG_ACK) {
-            if (tamanho >= sizeof(payload_ack_t)) {
-                payload_ack_t ap;
-                memcpy(&ap, payload, sizeof(ap));
-                int status = ntohl(ap.status);
-                if (status == 1) {
-                    // ACK de ordem de drone
-                    printf("[ACK RECEBIDO]\n");
-                    // heurística: assume ACK corresponde ao último enviado
-                    if (last_sent_alert >= 0 && last_sent_alert < total_alertas) {
-                        int id_c = alertas[last_sent_alert].id_cidade;
-                        printf("Cliente confirmou recebimento de ordem de drone para %s (ID=%d)\n\n",
-                               g->nodes[id_c]._nome, id_c);
-                    } else {
-                        printf("Cliente confirmou recebimento de ordem de drone (sem mapeamento)\n\n");
-                    }
-                } else if (status == 0) {
-                    // ACK telemetria (geralmente já tratado no cliente)
-                    // podemos logar se quiser
-                } else if (status == 2) {
-                    // ACK de conclusao (servidor normalmente envia ACK, mas cliente pode enviar)
-                    printf("[ACK RECEBIDO] status=2 (conclusão)\n\n");
-                }
-            }
-        } else if (tipo == MSG_CONCLUSAO) {
-            if (tamanho >= sizeof(payload_equipe_drone_t)) {
-                payload_equipe_drone_t p;
-                memcpy(&p, payload, sizeof(p));
-                int id_cidade = ntohl(p.id_cidade);
-                int id_equipe = ntohl(p.id_equipe);
-
-                // localizar alerta correspondente e liberar equipe
-                int found = -1;
-                for (int i = 0; i < total_alertas; i++) {
-                    if (alertas[i].id_cidade == id_cidade) {
-                        found = i;
-                        break;
-                    }
-                }
+            close(regioes[i].ipc);
+        }
+        if (arquivo_trace && captura_abre(arquivo_trace) < 0) return 1;
+        executa_roteador(sockfd);
 
-                printf("[MISSAO CONCLUÍDA]\n");
-                printf("Cidade atendida: %s (ID=%d)\n", g->nodes[id_cidade]._nome, id_cidade);
-                printf("Equipe : %s (ID=%d)\n", g->nodes[id_equipe]._nome, id_equipe);
+        // fecha os socketpairs: cada shard faz o último commit e sai
+        for (int i = 0; i < n_regioes; i++) close(regioes[i].fd);
+        while (wait(NULL) > 0) {
+        }
+        if (trace) fclose(trace);
+        close(sockfd);
+        return 0;
+    }
 
-                // libera equipe no grafo (marcar capital livre)
-                g->nodes[id_equipe]._ocupada = 0;
-                if (found != -1) {
-                    alertas[found].equipe_atuando = -1;
-                }
+    if (arquivo_trace && captura_abre(arquivo_trace) < 0) return 1;
 
-                printf("-> Equipe %s liberada para novas missões\n", g->nodes[id_equipe]._nome);
-                // envia ACK tipo=2
-                send_ack(sockfd, &client_addr, client_len, 2);
-                printf("-> ACK enviado (tipo=2)\n\n");
-            }
-        } else {
-            // outros tipos
+    while (1) {
+        uint8_t buf[4096];
+        struct sockaddr_storage client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        // com journal/captura: lê sem bloquear enquanto houver rajada e só faz o
+        // commit (e libera as respostas) quando o socket esvazia
+        int em_lote = journal.fd >= 0 || trace != NULL;
+        ssize_t n = recvfrom(sockfd, buf, sizeof(buf), em_lote ? MSG_DONTWAIT : 0,
+                             (struct sockaddr *)&client_addr, &client_len);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            journal_commit();
+            if (journal.desde_snapshot >= JOURNAL_SNAPSHOT) journal_snapshot(g);
+            if (trace) fflush(trace);
+            client_len = sizeof(client_addr);
+            n = recvfrom(sockfd, buf, sizeof(buf), 0, (struct sockaddr *)&client_addr, &client_len);
         }
+        if (n > 0) captura_registra(0, &client_addr, buf, (size_t)n);
+        if (n < (ssize_t)sizeof(header_t)) continue;
+
+        processa_datagrama(g, sockfd, buf, n, &client_addr, client_len);
     }
 
     close(sockfd);